@@ -0,0 +1,150 @@
+/**
+ * @brief 块分配器的分配/释放开销：pooled_block_allocator、malloc/free和new/delete三种4K块分配器。
+ * 用法：bench_alloc_churn [每项测试的次数(默认2000000)] [并发线程数(默认4)]
+ * churn：单线程按缓冲区扩容的顺序分配1、2、4块再释放；threads：多个线程同时做churn；
+ * cross：一个线程分配、另一个线程释放(TcpSocket把数据交给别的线程处理时就是这样)，
+ * 池化分配器上释放线程的缓存满了会把块还给全局仓库，分配线程的缓存空了再从仓库批量取回，
+ * 最后两列是cross期间4K级别每千次分配从仓库取块和调用malloc的次数(BlockPool::GetStats)。
+ * 数字是每次分配或释放的平均纳秒数，多线程的数字要和cpu核数一起看。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include "net/blockbuffer.h"
+
+using namespace deps;
+
+namespace{
+typedef std::chrono::steady_clock Clock;
+
+const size_t CHURN_BLOCK_SIZE = 4096;
+const size_t CROSS_BATCH = 256;         //cross里分配线程每攒够这么多块交给释放线程一次
+const size_t CROSS_MAX_QUEUED = 4096;   //释放线程最多积压的块数，超过时分配线程等待
+
+//不让编译器把没用到的分配优化掉
+inline void Escape(void* p){ asm volatile("" : : "g"(p) : "memory"); }
+
+double Elapsed(Clock::time_point start){
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//返回每次分配或释放的纳秒数
+template <typename A>
+double Churn(int iters){
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < iters; ++i){
+        char* a = A::ordered_malloc(1);
+        Escape(a);
+        char* b = A::ordered_malloc(2);
+        Escape(b);
+        A::ordered_free(a, 1);
+        char* c = A::ordered_malloc(4);
+        Escape(c);
+        A::ordered_free(b, 2);
+        A::ordered_free(c, 4);
+    }
+    return Elapsed(start) * 1e9 / (iters * 6.0);
+}
+
+//threads个线程各做iters/threads次churn，返回总时间平摊到每次分配或释放的纳秒数
+template <typename A>
+double Threads(int iters, int threads){
+    int each = iters / threads > 0 ? iters / threads : 1;
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < threads; ++i){
+        workers.push_back(std::thread([each](){ Churn<A>(each); }));
+    }
+    for(size_t i = 0; i < workers.size(); ++i){
+        workers[i].join();
+    }
+    return Elapsed(start) * 1e9 / (each * 6.0 * threads);
+}
+
+//一个线程分配count块、另一个线程释放，返回每块(一次分配加一次释放)的纳秒数
+template <typename A>
+double Cross(int count){
+    std::mutex mutex;
+    std::vector<char*> queue;
+    std::thread freer([&](){
+        std::vector<char*> local;
+        int freed = 0;
+        while(freed < count){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                local.swap(queue);
+            }
+            if(local.empty()){
+                std::this_thread::yield();
+                continue;
+            }
+            for(size_t i = 0; i < local.size(); ++i){
+                A::ordered_free(local[i], 1);
+            }
+            freed += local.size();
+            local.clear();
+        }
+    });
+    Clock::time_point start = Clock::now();
+    std::vector<char*> batch;
+    for(int i = 0; i < count; ++i){
+        char* p = A::ordered_malloc(1);
+        p[0] = 1;
+        batch.push_back(p);
+        if(batch.size() < CROSS_BATCH && i + 1 < count){
+            continue;
+        }
+        while(true){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(queue.size() < CROSS_MAX_QUEUED){
+                    queue.insert(queue.end(), batch.begin(), batch.end());
+                    break;
+                }
+            }
+            std::this_thread::yield();
+        }
+        batch.clear();
+    }
+    freer.join();
+    return Elapsed(start) * 1e9 / count;
+}
+
+template <typename A>
+void Run(const char* name, int iters, int threads, bool pooled){
+    double churn = Churn<A>(iters);
+    double multi = Threads<A>(iters, threads);
+    BlockPoolClassStats before = BlockPool::GetStats(CHURN_BLOCK_SIZE);
+    double cross = Cross<A>(iters);
+    BlockPoolClassStats after = BlockPool::GetStats(CHURN_BLOCK_SIZE);
+    if(pooled){
+        uint64_t allocs = after.m_allocCount - before.m_allocCount;
+        double depot = allocs > 0 ? 1000.0 * (after.m_depotHits - before.m_depotHits) / allocs : 0.0;
+        double mallocs = allocs > 0 ? 1000.0 * (after.m_mallocCount - before.m_mallocCount) / allocs : 0.0;
+        printf("%-12s %10.1f %10.1f %10.1f %12.2f %12.2f\n", name, churn, multi, cross, depot, mallocs);
+    }else{
+        printf("%-12s %10.1f %10.1f %10.1f %12s %12s\n", name, churn, multi, cross, "-", "-");
+    }
+}
+}
+
+int main(int argc, char** argv){
+    int iters = argc > 1 ? atoi(argv[1]) : 2000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    if(iters < 1){
+        iters = 1;
+    }
+    if(threads < 1){
+        threads = 1;
+    }
+    printf("cpus:%ld iterations:%d threads:%d block:%zu\n", sysconf(_SC_NPROCESSORS_ONLN), iters, threads, CHURN_BLOCK_SIZE);
+    printf("%-12s %10s %10s %10s %12s %12s\n", "allocator", "churn ns", "threads ns", "cross ns", "depot/1k", "malloc/1k");
+    Run<pooled_block_allocator<CHURN_BLOCK_SIZE> >("pooled", iters, threads, true);
+    Run<default_block_allocator_malloc_free<CHURN_BLOCK_SIZE> >("malloc_free", iters, threads, false);
+    Run<default_block_allocator_new_delete<CHURN_BLOCK_SIZE> >("new_delete", iters, threads, false);
+    return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * @brief 部分消费的开销：缓冲区里先积压depth字节，之后每次追加chunk字节、读一次、再erase(0, chunk)从头部消费同样多，
+ * 比较BlockBuffer和RingBuffer每秒消费的字节数。
+ * BlockBuffer每次erase都把剩下的数据搬到前面，代价随积压的数据量增长；RingBuffer只移动读位置。
+ * RingBuffer分两列：用data()读(和TcpSocket解包一样，回绕时要整理成一段)，以及用spans()读(不整理)。
+ * 用法：bench_buffer_consume [每种组合的毫秒数(默认300)]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <chrono>
+#include "net/blockbuffer.h"
+#include "net/ringbuffer.h"
+
+using namespace deps;
+
+namespace{
+typedef std::chrono::steady_clock Clock;
+
+const unsigned CONSUME_MAX_BLOCKS = 2048;      //4K的块，最多8M，能放下最深的积压再加一个chunk
+const int CONSUME_CHECK_INTERVAL = 64;          //每隔多少次看一次时间
+
+typedef BlockBuffer<def_block_alloc_4k, CONSUME_MAX_BLOCKS> block_buffer;
+typedef RingBuffer<def_block_alloc_4k, CONSUME_MAX_BLOCKS> ring_buffer;
+
+size_t g_sink = 0;      //读到的数据累加到这里，避免读被优化掉
+
+template <typename Buffer>
+inline void Touch(Buffer& buffer){ g_sink += buffer.data()[0]; }
+
+//只取两段视图，不整理
+struct SpanRead{
+    ring_buffer m_buffer;
+};
+inline void Touch(SpanRead& buffer){
+    struct iovec iov[2];
+    buffer.m_buffer.spans(iov);
+    g_sink += ((const char*)iov[0].iov_base)[0];
+}
+inline ring_buffer& Get(SpanRead& buffer){ return buffer.m_buffer; }
+template <typename Buffer>
+inline Buffer& Get(Buffer& buffer){ return buffer; }
+
+//返回每秒消费的MB数
+template <typename Buffer>
+double Run(size_t depth, size_t chunk, int ms){
+    Buffer buffer;
+    std::string backlog(depth, 'y');
+    std::string data(chunk, 'x');
+    if(!Get(buffer).append(backlog.data(), backlog.size())){
+        return 0.0;
+    }
+    uint64_t consumed = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::milliseconds(ms);
+    for(int i = 0; ; ++i){
+        if(i % CONSUME_CHECK_INTERVAL == 0 && Clock::now() >= end){
+            break;
+        }
+        Get(buffer).append(data.data(), data.size());
+        Touch(buffer);
+        Get(buffer).erase(0, chunk);
+        consumed += chunk;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return consumed / seconds / 1e6;
+}
+}
+
+int main(int argc, char** argv){
+    int ms = argc > 1 ? atoi(argv[1]) : 300;
+    if(ms < 1){
+        ms = 1;
+    }
+    size_t depths[] = {16 * 1024, 256 * 1024, 4 * 1024 * 1024};
+    size_t chunks[] = {512, 4096};
+    printf("%10s %6s %14s %14s %14s %8s\n", "depth", "chunk", "block MB/s", "ring data MB/s", "ring span MB/s", "ratio");
+    for(size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); ++i){
+        for(size_t j = 0; j < sizeof(chunks) / sizeof(chunks[0]); ++j){
+            double block = Run<block_buffer>(depths[i], chunks[j], ms);
+            double ring = Run<ring_buffer>(depths[i], chunks[j], ms);
+            double span = Run<SpanRead>(depths[i], chunks[j], ms);
+            printf("%10zu %6zu %14.1f %14.1f %14.1f %7.1fx\n", depths[i], chunks[j], block, ring, span,
+                block > 0 ? ring / block : 0.0);
+        }
+    }
+    return g_sink == 1 ? 1 : 0;
+}
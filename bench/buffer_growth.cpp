@@ -0,0 +1,107 @@
+/**
+ * @brief 缓冲区扩容的回归测试：BlockBuffer/RingBuffer以100字节一次连续追加到4MB(1024个4KB块)，
+ * 用计数的分配器统计扩容次数和扩容时实际搬动的字节数。
+ * 几何增长下扩容次数不能超过log2(1024)+1次，搬动的字节数不能超过最终容量，超出时返回非0，ctest会报失败。
+ * 按需增长的结果只打印出来做对比，不检查。
+ * 用法：bench_buffer_growth [每种组合的重复次数(默认20)]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "net/blockbuffer.h"
+#include "net/ringbuffer.h"
+
+using namespace deps;
+
+namespace{
+typedef std::chrono::steady_clock Clock;
+
+const size_t GROWTH_BLOCK_SIZE = 4096;
+const unsigned GROWTH_MAX_BLOCKS = 1024;
+const size_t GROWTH_CHUNK_SIZE = 100;
+
+size_t g_allocs = 0;    //分配次数，包括第一次
+size_t g_moves = 0;     //扩容时换了地址的次数
+size_t g_movedBytes = 0;
+
+//统计调用次数，实际分配交给A
+template <typename A>
+struct counting_allocator
+{
+    enum { requested_size = A::requested_size };
+
+    static char * ordered_malloc(size_t n) { ++g_allocs; return A::ordered_malloc(n); }
+    static void ordered_free(char * const block, size_t n) { A::ordered_free(block, n); }
+    static char * ordered_realloc(char * const block, size_t oldn, size_t newn, size_t used)
+    {
+        ++g_allocs;
+        char * p = A::ordered_realloc(block, oldn, newn, used);
+        if (p && p != block)
+        {
+            ++g_moves;
+            g_movedBytes += used;
+        }
+        return p;
+    }
+};
+
+size_t Log2(size_t n){
+    size_t bits = 0;
+    while(n > 1){
+        n >>= 1;
+        ++bits;
+    }
+    return bits;
+}
+
+//返回是否在几何增长的上限以内
+template <typename Buffer>
+bool Run(const char* name, int rounds, bool check){
+    char chunk[GROWTH_CHUNK_SIZE];
+    memset(chunk, 'x', sizeof(chunk));
+    g_allocs = g_moves = g_movedBytes = 0;
+    size_t capacity = 0;
+    Clock::time_point start = Clock::now();
+    for(int r = 0; r < rounds; ++r){
+        Buffer buffer;
+        while(buffer.append(chunk, sizeof(chunk))){
+        }
+        capacity = buffer.capacity();
+    }
+    double ms = std::chrono::duration<double>(Clock::now() - start).count() * 1000 / rounds;
+    size_t grows = g_allocs / rounds - 1;
+    size_t moves = g_moves / rounds;
+    size_t movedBytes = g_movedBytes / rounds;
+    size_t maxGrows = Log2(GROWTH_MAX_BLOCKS) + 1;
+    bool ok = !check || (grows <= maxGrows && movedBytes <= capacity);
+    printf("%-30s %6zu %6zu %10.1f %8.2f  %s\n", name, grows, moves, movedBytes / 1024.0, ms,
+        check ? (ok ? "ok" : "FAIL") : "-");
+    return ok;
+}
+}
+
+int main(int argc, char** argv){
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    if(rounds < 1){
+        rounds = 1;
+    }
+    printf("append %zu bytes each up to %u blocks of %zu bytes, max grows %zu\n",
+        GROWTH_CHUNK_SIZE, GROWTH_MAX_BLOCKS, GROWTH_BLOCK_SIZE, Log2(GROWTH_MAX_BLOCKS) + 1);
+    printf("%-30s %6s %6s %10s %8s  %s\n", "buffer", "grows", "moves", "movedKB", "ms", "check");
+
+    typedef counting_allocator<default_block_allocator_malloc_free<GROWTH_BLOCK_SIZE> > realloc_alloc;
+    typedef counting_allocator<default_block_allocator_new_delete<GROWTH_BLOCK_SIZE> > copy_alloc;
+    typedef counting_allocator<mmap_block_allocator<GROWTH_BLOCK_SIZE> > mmap_alloc;
+    typedef counting_allocator<pooled_block_allocator<GROWTH_BLOCK_SIZE> > pool_alloc;
+
+    bool ok = true;
+    ok &= Run<BlockBuffer<realloc_alloc, GROWTH_MAX_BLOCKS> >("block geometric realloc", rounds, true);
+    ok &= Run<BlockBuffer<copy_alloc, GROWTH_MAX_BLOCKS> >("block geometric new/copy", rounds, true);
+    ok &= Run<BlockBuffer<mmap_alloc, GROWTH_MAX_BLOCKS> >("block geometric mremap", rounds, true);
+    ok &= Run<BlockBuffer<pool_alloc, GROWTH_MAX_BLOCKS> >("block geometric pool", rounds, true);
+    ok &= Run<RingBuffer<realloc_alloc, GROWTH_MAX_BLOCKS> >("ring geometric realloc", rounds, true);
+    ok &= Run<RingBuffer<copy_alloc, GROWTH_MAX_BLOCKS> >("ring geometric new/copy", rounds, true);
+    Run<BlockBuffer<realloc_alloc, GROWTH_MAX_BLOCKS, exact_growth> >("block exact realloc", rounds, false);
+    Run<BlockBuffer<copy_alloc, GROWTH_MAX_BLOCKS, exact_growth> >("block exact new/copy", rounds, false);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+/**
+ * @brief 本机回环上的回显：epoll后端和io_uring后端每秒回显的消息数，以及io_uring后端每个消息平均的io_uring_enter次数。
+ * 用法：bench_echo_backend [客户端线程数(默认2)] [每项测试秒数(默认2)]
+ * 每个客户端线程持有若干连接，每轮在所有连接上各发一个消息再依次读回显。
+ * epoll后端每个消息至少有一次recv和一次writev；io_uring后端(6.0以上内核)的接收和发送都是完成事件，
+ * 每轮事件循环只有一次io_uring_enter，连接数越多，每次返回的完成事件越多，平均到每个消息的系统调用越少。
+ * 服务端只有一个事件循环，客户端和服务端在同一台机器上，数字要和cpu核数一起看。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "net/epoll_container_group.h"
+
+using namespace deps;
+
+namespace{
+const int BENCH_PORT = 19200;
+const size_t BENCH_MSG_SIZE = 64;
+
+class EchoHandler : public PacketHandler{
+public:
+    virtual int HandlePacket(const char* data, size_t size, SocketBase* s){
+        s->SendPacket(data, size);
+        return (int)size;
+    }
+    virtual void HandleClose(SocketBase* s){}
+};
+
+int Connect(int port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+//直接RST关闭，客户端不留TIME_WAIT
+void Abort(int fd){
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+}
+
+bool ReadFull(int fd, char* buf, size_t size){
+    size_t got = 0;
+    while(got < size){
+        ssize_t n = read(fd, buf + got, size - got);
+        if(n <= 0){
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+//每个客户端线程conns个连接，每轮全部发完再全部读回
+uint64_t RunEcho(int port, int clients, int conns, int seconds){
+    std::atomic<uint64_t> count(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < clients; ++i){
+        threads.push_back(std::thread([&](){
+            char buf[BENCH_MSG_SIZE] = {0};
+            std::vector<int> fds;
+            for(int j = 0; j < conns; ++j){
+                int fd = Connect(port);
+                if(fd >= 0){
+                    fds.push_back(fd);
+                }
+            }
+            uint64_t n = 0;
+            bool ok = !fds.empty();
+            while(!stop && ok){
+                for(size_t j = 0; j < fds.size() && ok; ++j){
+                    ok = (write(fds[j], buf, sizeof(buf)) == (ssize_t)sizeof(buf));
+                }
+                for(size_t j = 0; j < fds.size() && ok; ++j){
+                    ok = ReadFull(fds[j], buf, sizeof(buf));
+                }
+                if(ok){
+                    n += fds.size();
+                }
+            }
+            count += n;
+            for(size_t j = 0; j < fds.size(); ++j){
+                Abort(fds[j]);
+            }
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for(size_t i = 0; i < threads.size(); ++i){
+        threads[i].join();
+    }
+    return count / seconds;
+}
+
+//返回每秒消息数，监听失败返回0；enters返回服务端io_uring_enter的次数
+uint64_t Run(bool useIoUring, int port, int clients, int conns, int seconds, uint64_t* enters){
+    EchoHandler handler;
+    EpollContainerGroup group(1, 65536, 10, true, useIoUring);
+    if(!group.Listen(port, 1024, &handler) || !group.Start()){
+        printf("listen port:%d failed\n", port);
+        return 0;
+    }
+    uint64_t msgs = RunEcho(port, clients, conns, seconds);
+    group.Stop();
+    *enters = group.GetContainer(0)->GetStats().m_uringEnterCalls;
+    return msgs;
+}
+}
+
+int main(int argc, char** argv){
+    int clients = argc > 1 ? atoi(argv[1]) : 2;
+    int seconds = argc > 2 ? atoi(argv[2]) : 2;
+    //客户端RST关闭的连接会打错误日志
+    setloglevel(Logger::FATAL);
+    bool supported = IoUringContainer::IsSupported();
+    printf("cpus:%ld clients:%d seconds:%d io_uring:%s\n", sysconf(_SC_NPROCESSORS_ONLN), clients, seconds,
+        supported ? "yes" : "not supported, both rows use epoll");
+    printf("%8s %14s %14s %8s %12s\n", "conns", "epoll msgs/s", "uring msgs/s", "ratio", "enters/msg");
+    int connCounts[] = {1, 16, 256};
+    int port = BENCH_PORT;
+    for(size_t i = 0; i < sizeof(connCounts) / sizeof(connCounts[0]); ++i){
+        int conns = connCounts[i] / clients > 0 ? connCounts[i] / clients : 1;
+        uint64_t enters = 0;
+        uint64_t epoll = Run(false, port++, clients, conns, seconds, &enters);
+        uint64_t uring = Run(true, port++, clients, conns, seconds, &enters);
+        printf("%8d %14llu %14llu %7.2fx %12.3f\n", conns * clients, (unsigned long long)epoll, (unsigned long long)uring,
+            epoll > 0 ? (double)uring / epoll : 0.0, uring > 0 ? (double)enters / (uring * seconds) : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @brief EpollContainerGroup从1个到N个事件循环的扩展性：每秒新建连接数和每秒回显消息数。
+ * 用法：bench_loop_scaling [最大循环数(默认cpu核数)] [客户端线程数(默认8)] [每项测试秒数(默认2)]
+ * 循环数按1、2、4...翻倍直到最大循环数，客户端和服务端在同一台机器上，客户端线程会和事件循环抢cpu，
+ * 数字要和cpu核数一起看。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "net/epoll_container_group.h"
+
+using namespace deps;
+
+namespace{
+const int BENCH_PORT = 19100;
+const size_t BENCH_MSG_SIZE = 64;
+
+class EchoHandler : public PacketHandler{
+public:
+    virtual int HandlePacket(const char* data, size_t size, SocketBase* s){
+        s->SendPacket(data, size);
+        return (int)size;
+    }
+    virtual void HandleClose(SocketBase* s){}
+};
+
+int Connect(int port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+//直接RST关闭，客户端不留TIME_WAIT，避免临时端口耗尽
+void Abort(int fd){
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+}
+
+bool ReadFull(int fd, char* buf, size_t size){
+    size_t got = 0;
+    while(got < size){
+        ssize_t n = read(fd, buf + got, size - got);
+        if(n <= 0){
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+//每个客户端线程反复建立连接、发一个消息等回显、关闭
+uint64_t RunConnect(int port, int clients, int seconds){
+    std::atomic<uint64_t> count(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < clients; ++i){
+        threads.push_back(std::thread([&](){
+            char buf[BENCH_MSG_SIZE] = {0};
+            while(!stop){
+                int fd = Connect(port);
+                if(fd < 0){
+                    continue;
+                }
+                if(write(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) && ReadFull(fd, buf, sizeof(buf))){
+                    count++;
+                }
+                Abort(fd);
+            }
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for(size_t i = 0; i < threads.size(); ++i){
+        threads[i].join();
+    }
+    return count / seconds;
+}
+
+//每个客户端线程一个长连接，一问一答
+uint64_t RunEcho(int port, int clients, int seconds){
+    std::atomic<uint64_t> count(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < clients; ++i){
+        threads.push_back(std::thread([&](){
+            char buf[BENCH_MSG_SIZE] = {0};
+            int fd = Connect(port);
+            if(fd < 0){
+                return;
+            }
+            uint64_t n = 0;
+            while(!stop && write(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) && ReadFull(fd, buf, sizeof(buf))){
+                ++n;
+            }
+            count += n;
+            Abort(fd);
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for(size_t i = 0; i < threads.size(); ++i){
+        threads[i].join();
+    }
+    return count / seconds;
+}
+}
+
+int main(int argc, char** argv){
+    int maxLoops = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int clients = argc > 2 ? atoi(argv[2]) : 8;
+    int seconds = argc > 3 ? atoi(argv[3]) : 2;
+    if(maxLoops < 1){
+        maxLoops = 1;
+    }
+    //客户端RST关闭的连接会打错误日志
+    setloglevel(Logger::FATAL);
+    printf("cpus:%ld clients:%d seconds:%d\n", sysconf(_SC_NPROCESSORS_ONLN), clients, seconds);
+    printf("%6s %12s %12s\n", "loops", "conn/s", "msgs/s");
+    for(int loops = 1; ; loops *= 2){
+        if(loops > maxLoops){
+            loops = maxLoops;
+        }
+        EchoHandler handler;
+        EpollContainerGroup group(loops, 65536, 10, true);
+        int port = BENCH_PORT + loops;
+        if(!group.Listen(port, 1024, &handler) || !group.Start()){
+            printf("listen port:%d failed\n", port);
+            return 1;
+        }
+        uint64_t conns = RunConnect(port, clients, seconds);
+        uint64_t msgs = RunEcho(port, clients, seconds);
+        group.Stop();
+        printf("%6d %12llu %12llu\n", loops, (unsigned long long)conns, (unsigned long long)msgs);
+        if(loops == maxLoops){
+            break;
+        }
+    }
+    return 0;
+}
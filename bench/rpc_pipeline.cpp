@@ -0,0 +1,118 @@
+/**
+ * @brief 本机回环上RpcClient的调用吞吐：一次只有一个未完成的调用和同时保持N个未完成的调用(流水线)每秒完成的调用数。
+ * 用法：bench_rpc_pipeline [每项测试秒数(默认2)] [最大窗口(默认256)]
+ * 服务端是单个事件循环的回显，客户端在当前线程里跑自己的容器，每个应答回调里再发一个调用，
+ * 窗口从1开始每次乘4，直到最大窗口。窗口为1时每个调用都要等一个来回，窗口越大，一次读写处理的请求和应答越多。
+ * 客户端和服务端在同一台机器上，数字要和cpu核数一起看。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include "net/epoll_container_group.h"
+#include "net/rpc_client.h"
+
+using namespace deps;
+
+namespace{
+typedef std::chrono::steady_clock Clock;
+
+const int BENCH_PORT = 19400;
+const uint64_t BENCH_CALL_TIMEOUT = 1000;      //调用超时(毫秒)
+
+class EchoHandler : public PacketHandler{
+public:
+    virtual int HandlePacket(const char* data, size_t size, SocketBase* s){
+        s->SendPacket(data, size);
+        return (int)size;
+    }
+    virtual void HandleClose(SocketBase* s){}
+    virtual FrameType GetFrameType(){return FrameType::proto;}
+};
+
+struct EchoRequest : public Marshallable{
+    EchoRequest():m_value(0){}
+    virtual void marshal(Pack& p) const{ p << m_value; }
+    virtual void unmarshal(const Unpack& u){ u >> m_value; }
+    uint32_t m_value;
+};
+
+struct Result{
+    uint64_t m_ok;
+    uint64_t m_failed;      //超时、连接关闭或者发送失败的调用数
+    double m_seconds;
+};
+
+//保持window个未完成的调用，跑seconds秒后停止补发，等剩下的调用完成
+Result RunWindow(EpollContainer* container, RpcClient* client, Encoder& enc, int window, int seconds){
+    Result result = {0, 0, 0.0};
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::seconds(seconds);
+    bool stopping = false;
+    int outstanding = 0;
+    RpcClient::Callback cb;
+    cb = [&](RpcStatus status, const char* data, size_t size){
+        --outstanding;
+        if(RpcStatus::ok == status){
+            ++result.m_ok;
+        }else{
+            ++result.m_failed;
+        }
+        if(!stopping && client->Call(enc, BENCH_CALL_TIMEOUT, cb) != 0){
+            ++outstanding;
+        }
+    };
+    for(int i = 0; i < window; ++i){
+        if(client->Call(enc, BENCH_CALL_TIMEOUT, cb) != 0){
+            ++outstanding;
+        }
+    }
+    while(outstanding > 0){
+        container->HandleSockets();
+        if(!stopping && Clock::now() >= end){
+            stopping = true;
+        }
+    }
+    result.m_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+}
+
+int main(int argc, char** argv){
+    int seconds = argc > 1 ? atoi(argv[1]) : 2;
+    int maxWindow = argc > 2 ? atoi(argv[2]) : 256;
+    if(seconds < 1){
+        seconds = 1;
+    }
+    if(maxWindow < 1){
+        maxWindow = 1;
+    }
+    setloglevel(Logger::FATAL);
+    EchoHandler handler;
+    EpollContainerGroup group(1, 1024, 10);
+    if(!group.Listen(BENCH_PORT, 128, &handler) || !group.Start()){
+        printf("listen port:%d failed\n", BENCH_PORT);
+        return 1;
+    }
+    EpollContainer container(1024, 1);
+    RpcClient client(&container, htonl(INADDR_LOOPBACK), BENCH_PORT);
+    EchoRequest req;
+    Encoder enc;
+    enc.serialize(1, req);
+
+    printf("cpus:%ld seconds:%d\n", sysconf(_SC_NPROCESSORS_ONLN), seconds);
+    printf("%8s %14s %8s %10s\n", "window", "calls/s", "ratio", "failed");
+    double serial = 0.0;
+    for(int window = 1; window <= maxWindow; window *= 4){
+        Result result = RunWindow(&container, &client, enc, window, seconds);
+        double rate = result.m_ok / result.m_seconds;
+        if(1 == window){
+            serial = rate;
+        }
+        printf("%8d %14.0f %7.2fx %10llu\n", window, rate, serial > 0 ? rate / serial : 0.0,
+            (unsigned long long)result.m_failed);
+    }
+    client.Close();
+    group.Stop();
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @brief 连接表查找：EpollContainer按描述符索引的槽数组(带generation检查)和原来的std::map<int, SocketBase*>比较，
+ * 分别在1万、10万、100万个连接时测每秒添加次数和随机查找次数。
+ * 用法：bench_socket_table [每种规模的查找次数(默认1000万)]
+ * 不需要真的打开这么多描述符：容器的多路复用后端换成空实现，连接对象只设置描述符。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "net/epoll_container.h"
+
+using namespace deps;
+
+namespace{
+typedef std::chrono::steady_clock Clock;
+
+class FakeSocket : public SocketBase{
+public:
+    virtual void HandleRead(char* max_read_buffer, size_t max_read_size){}
+    virtual void HandleWrite(){}
+    virtual void HandleError(){}
+    virtual void HandleTimeout(){}
+    virtual bool SendPacket(const char* data, size_t size){return false;}
+    virtual void Close(){}
+};
+
+//不注册任何描述符的容器，只留下连接表
+class TableContainer : public EpollContainer{
+public:
+    TableContainer(int maxFdCount):EpollContainer(maxFdCount, 0, false, true){}
+    SocketBase* Lookup(uint64_t key){return GetSocket(key);}
+protected:
+    virtual bool CtlSocket(int op, int fd, uint64_t key, uint64_t events){return true;}
+    virtual int WaitEvents(int waitTime){return 0;}
+};
+
+double Seconds(Clock::time_point start){
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//固定种子的线性同余，两种表用同一个访问顺序
+std::vector<uint32_t> RandomIndexes(size_t count, size_t range){
+    std::vector<uint32_t> indexes(count);
+    uint64_t x = 88172645463325252ULL;
+    for(size_t i = 0; i < count; ++i){
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        indexes[i] = (uint32_t)((x >> 33) % range);
+    }
+    return indexes;
+}
+
+void Run(size_t fdCount, size_t lookups){
+    std::vector<FakeSocket> sockets(fdCount);
+    std::vector<uint32_t> indexes = RandomIndexes(lookups, fdCount);
+
+    TableContainer container((int)fdCount + 1);
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < fdCount; ++i){
+        sockets[i].SetFd((int)i);
+        container.AddSocket(&sockets[i], SOCKET_EVENT_READ);
+    }
+    double slotAdd = Seconds(start);
+    std::vector<uint64_t> keys(fdCount);
+    for(size_t i = 0; i < fdCount; ++i){
+        keys[i] = sockets[i].GetId();
+    }
+    size_t hits = 0;
+    start = Clock::now();
+    for(size_t i = 0; i < lookups; ++i){
+        hits += (nullptr != container.Lookup(keys[indexes[i]]));
+    }
+    double slotLookup = Seconds(start);
+
+    std::map<int, SocketBase*> table;
+    start = Clock::now();
+    for(size_t i = 0; i < fdCount; ++i){
+        table[(int)i] = &sockets[i];
+    }
+    double mapAdd = Seconds(start);
+    start = Clock::now();
+    for(size_t i = 0; i < lookups; ++i){
+        std::map<int, SocketBase*>::iterator it = table.find((int)indexes[i]);
+        hits += (it != table.end() && nullptr != it->second);
+    }
+    double mapLookup = Seconds(start);
+
+    if(hits != 2 * lookups){
+        printf("lookup miss: %zu of %zu\n", 2 * lookups - hits, 2 * lookups);
+    }
+    printf("%8zu %14.1f %14.1f %8.1fx %12.2f %12.2f\n", fdCount,
+        lookups / slotLookup / 1e6, lookups / mapLookup / 1e6, mapLookup / slotLookup,
+        fdCount / slotAdd / 1e6, fdCount / mapAdd / 1e6);
+}
+}
+
+int main(int argc, char** argv){
+    size_t lookups = argc > 1 ? (size_t)atol(argv[1]) : 10000000;
+    setloglevel(Logger::FATAL);
+    printf("%8s %14s %14s %9s %12s %12s\n", "fds", "slot Mlook/s", "map Mlook/s", "speedup", "slot Madd/s", "map Madd/s");
+    size_t counts[] = {10000, 100000, 1000000};
+    for(size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i){
+        Run(counts[i], lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * @brief 本机回环上的UDP回显：普通收发、批量模式(UDP_MODE_BATCH)和分段卸载模式(UDP_MODE_OFFLOAD)下
+ * 服务端每秒处理的数据报数，以及平均每个数据报的接收/发送系统调用次数(来自ContainerStats)。
+ * 用法：bench_udp_batch [每项测试秒数(默认2)] [数据报大小(默认64)]
+ * 客户端每次发出UDP_BATCH_SIZE(32)个同样大小的数据报，内核支持UDP_SEGMENT时用一次分段发送，
+ * 这样开了UDP_GRO的服务端能收到合并的大包；没有开的服务端由内核切开后逐个收到，三种模式的客户端负载相同。
+ * 客户端限制在途的数据报个数，避免回环上丢包把数字拉低，数字要和cpu核数一起看。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/udp.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "net/epoll_container.h"
+#include "net/udp_socket.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+using namespace deps;
+
+namespace{
+const int BENCH_PORT = 19300;
+const uint64_t BENCH_MAX_IN_FLIGHT = 4096;      //客户端最多在途的数据报个数
+
+class EchoHandler : public PacketHandler{
+public:
+    EchoHandler():m_count(0){}
+    virtual int HandlePacket(const char* data, size_t size, SocketBase* s){
+        ++m_count;
+        s->SendPacket(data, size);
+        return (int)size;
+    }
+    virtual void HandleClose(SocketBase* s){}
+    std::atomic<uint64_t> m_count;
+};
+
+int Connect(int port){
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    int size = 16 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size));
+    struct timeval tv = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+//一次发出UDP_BATCH_SIZE个数据报，能用UDP_SEGMENT时是一次sendmsg，否则是一次sendmmsg，返回发出的个数
+class Sender{
+public:
+    Sender(int fd, size_t size):m_fd(fd), m_data(size * UDP_BATCH_SIZE, 0){
+        int segment = (int)size;
+        m_gso = (0 == setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)));
+        for(int i = 0; i < UDP_BATCH_SIZE; ++i){
+            m_iov[i].iov_base = &m_data[i * size];
+            m_iov[i].iov_len = size;
+            memset(&m_msgs[i], 0, sizeof(m_msgs[i]));
+            m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+            m_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+    int Send(){
+        if(m_gso){
+            return send(m_fd, m_data.data(), m_data.size(), 0) > 0 ? UDP_BATCH_SIZE : 0;
+        }
+        int n = sendmmsg(m_fd, m_msgs, UDP_BATCH_SIZE, 0);
+        return n > 0 ? n : 0;
+    }
+    bool IsSegmented() const{ return m_gso; }
+private:
+    int m_fd;
+    std::string m_data;
+    bool m_gso;
+    struct iovec m_iov[UDP_BATCH_SIZE];
+    struct mmsghdr m_msgs[UDP_BATCH_SIZE];
+};
+
+struct Result{
+    double m_dgrams;        //服务端每秒处理的数据报数
+    double m_recvCalls;     //每个数据报的接收系统调用次数
+    double m_sendCalls;     //每个数据报的发送系统调用次数
+    bool m_segmented;       //客户端是否用UDP_SEGMENT发送
+};
+
+bool Run(int mode, int port, int seconds, size_t size, Result* result){
+    EchoHandler handler;
+    EpollContainer container(16, 5, true);
+    if(!UdpSocket::Listen(port, 0, &container, &handler, mode)){
+        printf("listen port:%d failed\n", port);
+        return false;
+    }
+    int fd = Connect(port);
+    if(fd < 0){
+        printf("connect port:%d failed\n", port);
+        return false;
+    }
+    std::atomic<bool> stop(false);
+    std::thread loop([&](){
+        while(!stop){
+            container.HandleSockets();
+        }
+    });
+    std::atomic<uint64_t> echoed(0);
+    std::thread reader([&](){
+        std::string buf(size * UDP_BATCH_SIZE, 0);
+        struct iovec iov[UDP_BATCH_SIZE];
+        struct mmsghdr msgs[UDP_BATCH_SIZE];
+        for(int i = 0; i < UDP_BATCH_SIZE; ++i){
+            iov[i].iov_base = &buf[i * size];
+            iov[i].iov_len = size;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while(!stop){
+            int n = recvmmsg(fd, msgs, UDP_BATCH_SIZE, MSG_WAITFORONE, NULL);
+            if(n > 0){
+                echoed += n;
+            }
+        }
+    });
+
+    Sender sender(fd, size);
+    uint64_t sent = 0;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while(std::chrono::steady_clock::now() < end){
+        if(sent > echoed + BENCH_MAX_IN_FLIGHT){
+            std::this_thread::yield();
+            continue;
+        }
+        sent += sender.Send();
+    }
+    //计数在发送停止时截止，后面只是等在途的数据报处理完再退出
+    const ContainerStats& stats = container.GetStats();
+    uint64_t count = handler.m_count;
+    uint64_t recvCalls = stats.m_udpRecvCalls, recvCount = stats.m_udpRecvCount;
+    uint64_t sendCalls = stats.m_udpSendCalls, sendCount = stats.m_udpSendCount;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    stop = true;
+    loop.join();
+    reader.join();
+    close(fd);
+
+    result->m_dgrams = (double)count / seconds;
+    result->m_recvCalls = recvCount > 0 ? (double)recvCalls / recvCount : 0.0;
+    result->m_sendCalls = sendCount > 0 ? (double)sendCalls / sendCount : 0.0;
+    result->m_segmented = sender.IsSegmented();
+    return true;
+}
+}
+
+int main(int argc, char** argv){
+    int seconds = argc > 1 ? atoi(argv[1]) : 2;
+    size_t size = argc > 2 ? (size_t)atoi(argv[2]) : 64;
+    if(seconds < 1){
+        seconds = 1;
+    }
+    if(size < 1 || size > 1400){
+        size = 64;
+    }
+    setloglevel(Logger::FATAL);
+    const char* names[] = {"plain", "batch", "offload"};
+    int modes[] = {0, UDP_MODE_BATCH, UDP_MODE_OFFLOAD};
+    int port = BENCH_PORT;
+    Result results[3];
+    for(int i = 0; i < 3; ++i){
+        if(!Run(modes[i], port++, seconds, size, &results[i])){
+            return 1;
+        }
+    }
+    printf("cpus:%ld seconds:%d datagram:%zu bytes client UDP_SEGMENT:%s\n", sysconf(_SC_NPROCESSORS_ONLN), seconds, size,
+        results[0].m_segmented ? "yes" : "no");
+    printf("%-8s %14s %8s %16s %16s\n", "mode", "dgrams/s", "ratio", "recv calls/dgram", "send calls/dgram");
+    for(int i = 0; i < 3; ++i){
+        printf("%-8s %14.0f %7.2fx %16.4f %16.4f\n", names[i], results[i].m_dgrams,
+            results[0].m_dgrams > 0 ? results[i].m_dgrams / results[0].m_dgrams : 0.0,
+            results[i].m_recvCalls, results[i].m_sendCalls);
+    }
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "block_pool.h"
+#include "../sys/thread_mutex.h"
+#include "../sys/locker.h"
+
+using namespace deps;
+
+namespace{
+//空闲块的开头当作链表节点
+struct FreeBlock{
+    FreeBlock* m_next;
+};
+
+struct FreeList{
+    FreeList():m_head(nullptr), m_count(0){}
+    void Push(FreeBlock* block){
+        block->m_next = m_head;
+        m_head = block;
+        ++m_count;
+    }
+    FreeBlock* Pop(){
+        FreeBlock* block = m_head;
+        m_head = block->m_next;
+        --m_count;
+        return block;
+    }
+    //从头部摘下n个块挂到to的头部
+    void MoveTo(FreeList& to, size_t n){
+        while(n-- > 0 && m_count > 0){
+            to.Push(Pop());
+        }
+    }
+    FreeBlock* m_head;
+    size_t m_count;
+};
+
+//全局仓库，每个大小级别一个
+struct Depot{
+    Depot():m_allocCount(0), m_cacheHits(0), m_depotHits(0), m_mallocCount(0), m_freeCount(0){}
+    ThreadMutex m_mutex;
+    FreeList m_list;
+    std::atomic<uint64_t> m_allocCount;
+    std::atomic<uint64_t> m_cacheHits;
+    std::atomic<uint64_t> m_depotHits;
+    std::atomic<uint64_t> m_mallocCount;
+    std::atomic<uint64_t> m_freeCount;
+};
+
+size_t ClassSize(int c){
+    return (size_t)BLOCK_POOL_MIN_SIZE << c;
+}
+
+size_t CacheLimit(int c){
+    size_t n = BLOCK_POOL_CACHE_BYTES / ClassSize(c);
+    return n < 8 ? 8 : n;
+}
+
+size_t DepotLimit(int c){
+    return BLOCK_POOL_DEPOT_BYTES / ClassSize(c);
+}
+
+//进程退出时其他静态对象的析构里可能还会释放块，仓库不析构
+Depot* Depots(){
+    static Depot* depots = new Depot[BLOCK_POOL_CLASS_COUNT];
+    return depots;
+}
+
+//把list里超过仓库上限的块还给malloc，调用时持有仓库的锁
+void TrimDepot(Depot& depot, int c){
+    size_t limit = DepotLimit(c);
+    while(depot.m_list.m_count > limit){
+        free(depot.m_list.Pop());
+    }
+}
+
+//线程缓存：分配和释放的计数先记在本线程，和仓库交换时再汇总，避免多个线程争用同一个计数
+struct ThreadCache{
+    ThreadCache(){
+        for(int c = 0; c < BLOCK_POOL_CLASS_COUNT; ++c){
+            m_allocCount[c] = 0;
+            m_cacheHits[c] = 0;
+            m_freeCount[c] = 0;
+        }
+    }
+    ~ThreadCache();
+    void FlushStats(int c){
+        Depot& depot = Depots()[c];
+        depot.m_allocCount.fetch_add(m_allocCount[c], std::memory_order_relaxed);
+        depot.m_cacheHits.fetch_add(m_cacheHits[c], std::memory_order_relaxed);
+        depot.m_freeCount.fetch_add(m_freeCount[c], std::memory_order_relaxed);
+        m_allocCount[c] = 0;
+        m_cacheHits[c] = 0;
+        m_freeCount[c] = 0;
+    }
+    FreeList m_lists[BLOCK_POOL_CLASS_COUNT];
+    uint64_t m_allocCount[BLOCK_POOL_CLASS_COUNT];
+    uint64_t m_cacheHits[BLOCK_POOL_CLASS_COUNT];
+    uint64_t m_freeCount[BLOCK_POOL_CLASS_COUNT];
+};
+
+thread_local ThreadCache t_cache;
+//线程缓存析构之后(线程退出过程中)的分配和释放直接走仓库
+thread_local bool t_cacheDestroyed = false;
+
+ThreadCache::~ThreadCache(){
+    t_cacheDestroyed = true;
+    for(int c = 0; c < BLOCK_POOL_CLASS_COUNT; ++c){
+        FlushStats(c);
+        Depot& depot = Depots()[c];
+        Locker<ThreadMutex> lock(depot.m_mutex);
+        m_lists[c].MoveTo(depot.m_list, m_lists[c].m_count);
+        TrimDepot(depot, c);
+    }
+}
+
+char* DepotAlloc(int c){
+    Depot& depot = Depots()[c];
+    depot.m_allocCount.fetch_add(1, std::memory_order_relaxed);
+    {
+        Locker<ThreadMutex> lock(depot.m_mutex);
+        if(depot.m_list.m_count > 0){
+            depot.m_depotHits.fetch_add(1, std::memory_order_relaxed);
+            return (char*)depot.m_list.Pop();
+        }
+    }
+    depot.m_mallocCount.fetch_add(1, std::memory_order_relaxed);
+    return (char*)malloc(ClassSize(c));
+}
+
+void DepotFree(int c, char* block){
+    Depot& depot = Depots()[c];
+    depot.m_freeCount.fetch_add(1, std::memory_order_relaxed);
+    Locker<ThreadMutex> lock(depot.m_mutex);
+    if(depot.m_list.m_count >= DepotLimit(c)){
+        free(block);
+        return;
+    }
+    depot.m_list.Push((FreeBlock*)block);
+}
+}
+
+int BlockPool::SizeClass(size_t size){
+    if(size > BLOCK_POOL_MAX_SIZE){
+        return -1;
+    }
+    int c = 0;
+    while(ClassSize(c) < size){
+        ++c;
+    }
+    return c;
+}
+
+char* BlockPool::Alloc(size_t size){
+    int c = SizeClass(size);
+    if(c < 0){
+        return (char*)malloc(size);
+    }
+    if(t_cacheDestroyed){
+        return DepotAlloc(c);
+    }
+    ThreadCache& cache = t_cache;
+    FreeList& list = cache.m_lists[c];
+    if(list.m_count > 0){
+        cache.m_allocCount[c]++;
+        cache.m_cacheHits[c]++;
+        return (char*)list.Pop();
+    }
+    //缓存空了从仓库批量取一半容量
+    cache.FlushStats(c);
+    Depot& depot = Depots()[c];
+    depot.m_allocCount.fetch_add(1, std::memory_order_relaxed);
+    {
+        Locker<ThreadMutex> lock(depot.m_mutex);
+        depot.m_list.MoveTo(list, CacheLimit(c) / 2);
+    }
+    if(list.m_count > 0){
+        depot.m_depotHits.fetch_add(1, std::memory_order_relaxed);
+        return (char*)list.Pop();
+    }
+    depot.m_mallocCount.fetch_add(1, std::memory_order_relaxed);
+    return (char*)malloc(ClassSize(c));
+}
+
+void BlockPool::Free(char* block, size_t size){
+    if(nullptr == block){
+        return;
+    }
+    int c = SizeClass(size);
+    if(c < 0){
+        free(block);
+        return;
+    }
+    if(t_cacheDestroyed){
+        DepotFree(c, block);
+        return;
+    }
+    ThreadCache& cache = t_cache;
+    FreeList& list = cache.m_lists[c];
+    list.Push((FreeBlock*)block);
+    cache.m_freeCount[c]++;
+    //缓存满了把一半还给仓库，别的线程可以取走
+    size_t limit = CacheLimit(c);
+    if(list.m_count > limit){
+        cache.FlushStats(c);
+        Depot& depot = Depots()[c];
+        Locker<ThreadMutex> lock(depot.m_mutex);
+        list.MoveTo(depot.m_list, limit / 2);
+        TrimDepot(depot, c);
+    }
+}
+
+char* BlockPool::Realloc(char* block, size_t oldSize, size_t newSize, size_t used){
+    int oldClass = SizeClass(oldSize);
+    int newClass = SizeClass(newSize);
+    if(oldClass < 0 && newClass < 0){
+        return (char*)realloc(block, newSize);
+    }
+    if(oldClass == newClass){
+        return block;
+    }
+    char* newBlock = Alloc(newSize);
+    if(nullptr == newBlock){
+        return nullptr;
+    }
+    memcpy(newBlock, block, std::min(used, std::min(oldSize, newSize)));
+    Free(block, oldSize);
+    return newBlock;
+}
+
+void BlockPool::Prewarm(size_t size, size_t count){
+    int c = SizeClass(size);
+    if(c < 0){
+        return;
+    }
+    Depot& depot = Depots()[c];
+    Locker<ThreadMutex> lock(depot.m_mutex);
+    for(size_t i = 0; i < count && depot.m_list.m_count < DepotLimit(c); ++i){
+        char* block = (char*)malloc(ClassSize(c));
+        if(nullptr == block){
+            break;
+        }
+        depot.m_list.Push((FreeBlock*)block);
+    }
+}
+
+BlockPoolClassStats BlockPool::GetStats(size_t size){
+    BlockPoolClassStats stats = BlockPoolClassStats();
+    int c = SizeClass(size);
+    if(c < 0){
+        return stats;
+    }
+    Depot& depot = Depots()[c];
+    stats.m_allocCount = depot.m_allocCount.load(std::memory_order_relaxed);
+    stats.m_cacheHits = depot.m_cacheHits.load(std::memory_order_relaxed);
+    stats.m_depotHits = depot.m_depotHits.load(std::memory_order_relaxed);
+    stats.m_mallocCount = depot.m_mallocCount.load(std::memory_order_relaxed);
+    stats.m_freeCount = depot.m_freeCount.load(std::memory_order_relaxed);
+    Locker<ThreadMutex> lock(depot.m_mutex);
+    stats.m_depotBlocks = depot.m_list.m_count;
+    return stats;
+}
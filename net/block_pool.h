@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace deps{
+#define BLOCK_POOL_MIN_SIZE     1024                //最小的大小级别
+#define BLOCK_POOL_MAX_SIZE     32*1024             //最大的大小级别，更大的直接malloc
+#define BLOCK_POOL_CLASS_COUNT  6                   //1k、2k、4k、8k、16k、32k
+#define BLOCK_POOL_CACHE_BYTES  256*1024            //每个线程每个大小级别最多缓存的字节数
+#define BLOCK_POOL_DEPOT_BYTES  64*1024*1024        //全局仓库每个大小级别最多保留的字节数
+
+//每个大小级别的统计
+struct BlockPoolClassStats{
+    uint64_t m_allocCount;      //分配次数
+    uint64_t m_cacheHits;       //从线程缓存分配的次数
+    uint64_t m_depotHits;       //线程缓存为空、从全局仓库批量取到的次数
+    uint64_t m_mallocCount;     //仓库也为空、调用malloc的次数
+    uint64_t m_freeCount;       //释放次数
+    uint64_t m_depotBlocks;     //全局仓库里当前的块数
+};
+
+/**
+ * @brief 按大小级别(1k到32k的2的幂)池化的块分配器。
+ * 每个线程每个级别有一个空闲链表缓存，分配和释放都只操作本线程的缓存，不加锁；
+ * 缓存空了从全局仓库批量取一半容量，缓存满了把一半还给仓库，所以在一个线程分配、在另一个线程释放的块
+ * 也会经过仓库回到分配线程。线程退出时缓存全部还给仓库，仓库超过上限的部分还给malloc。
+ * 超过32k的请求直接malloc/free。释放时必须传入和分配时相同的size。
+ */
+class BlockPool{
+public:
+    static char* Alloc(size_t size);
+    static void Free(char* block, size_t size);
+    //把oldSize的块换成newSize，保留前used字节；新旧大小都超过32k时用realloc，同一级别直接返回原块。失败返回nullptr，原块不变
+    static char* Realloc(char* block, size_t oldSize, size_t newSize, size_t used);
+    //预先分配count个size所在级别的块放到全局仓库，启动时调用避免请求高峰时malloc
+    static void Prewarm(size_t size, size_t count);
+    //size所在级别的统计，size超过32k时返回全0
+    static BlockPoolClassStats GetStats(size_t size);
+    //size所在的级别，超过32k时返回-1
+    static int SizeClass(size_t size);
+};
+
+//可以作为BlockBuffer/RingBuffer的BlockAllocator，见blockbuffer.h里的pool_block_alloc_*
+template <unsigned BlockSize>
+struct pooled_block_allocator
+{
+    enum { requested_size = BlockSize };
+
+    static char * ordered_malloc(size_t n) { return BlockPool::Alloc(requested_size * n); }
+    static void ordered_free(char * const block, size_t n) { BlockPool::Free(block, requested_size * n); }
+    static char * ordered_realloc(char * const block, size_t oldn, size_t newn, size_t used) { return BlockPool::Realloc(block, requested_size * oldn, requested_size * newn, used); }
+};
+}
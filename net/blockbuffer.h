@@ -5,17 +5,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <atomic>
+#include <algorithm>
+#include <typeinfo>
+#include <sys/mman.h>
+#include "block_pool.h"
+#include "buffer_memory.h"
 
 namespace deps{
-#ifdef MONITOR
-class MonitorCapacity
-{
-public:
-    static std::atomic<uint64_t> g_currentTotalCapacity;
-};
-std::atomic<uint64_t> MonitorCapacity::g_currentTotalCapacity(0);
-#endif
-
 template <unsigned BlockSize>
 struct default_block_allocator_malloc_free
 {
@@ -23,6 +19,8 @@ struct default_block_allocator_malloc_free
 
     static char * ordered_malloc(size_t n) { return (char *)malloc(requested_size * n); }
     static void ordered_free(char * const block, size_t) { free(block); }
+    // 扩展到newn块，至少保留前used字节，失败返回NULL、原块不变；realloc能原地扩展时不拷贝，mmap分配的大块用mremap
+    static char * ordered_realloc(char * const block, size_t, size_t newn, size_t) { return (char *)realloc(block, requested_size * newn); }
 };
 
 template <unsigned BlockSize>
@@ -32,9 +30,79 @@ struct default_block_allocator_new_delete
 
     static char * ordered_malloc(size_t n){ return new (std::nothrow) char[requested_size * n]; }
     static void ordered_free(char * const block, size_t){ delete [] block; }
+    static char * ordered_realloc(char * const block, size_t oldn, size_t newn, size_t used)
+    {
+        char * newblock = ordered_malloc(newn);
+        if (newblock)
+        {
+            memcpy(newblock, block, used);
+            ordered_free(block, oldn);
+        }
+        return newblock;
+    }
+};
+
+// 直接mmap分配，扩容时mremap只移动页表不拷贝数据，适合会涨到几MB的缓冲区；BlockSize必须是页大小的整数倍
+// mremap只有linux有，其他系统扩容时重新mmap再拷贝已用的数据
+template <unsigned BlockSize>
+struct mmap_block_allocator
+{
+    enum { requested_size = BlockSize };
+
+    static char * ordered_malloc(size_t n)
+    {
+        void * p = mmap(NULL, requested_size * n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return MAP_FAILED == p ? NULL : (char *)p;
+    }
+    static void ordered_free(char * const block, size_t n) { munmap(block, requested_size * n); }
+    static char * ordered_realloc(char * const block, size_t oldn, size_t newn, size_t used)
+    {
+#ifdef __linux__
+        void * p = mremap(block, requested_size * oldn, requested_size * newn, MREMAP_MAYMOVE);
+        return MAP_FAILED == p ? NULL : (char *)p;
+#else
+        char * newblock = ordered_malloc(newn);
+        if (newblock)
+        {
+            memcpy(newblock, block, used);
+            ordered_free(block, oldn);
+        }
+        return newblock;
+#endif
+    }
+};
+
+// 增长策略：容量不够时由当前块数和至少需要的块数算出新的块数，结果再限制在最大块数以内
+// 按需增长：只分配需要的块，最省内存，连续的小追加每跨过一个块就要重新分配一次
+struct exact_growth
+{
+    static size_t grow(size_t, size_t need) { return need; }
+};
+
+// 几何增长：至少翻倍，连续追加到n块只重新分配log(n)次，最多空出一半容量
+struct geometric_growth
+{
+    static size_t grow(size_t cur, size_t need) { return need > cur * 2 ? need : cur * 2; }
 };
 
-#ifdef  USE_ALLOCATOR_NEW_DELETE
+//按大小级别池化、带线程缓存的分配器，见block_pool.h
+typedef pooled_block_allocator<1*1024> pool_block_alloc_1k;
+typedef pooled_block_allocator<2*1024> pool_block_alloc_2k;
+typedef pooled_block_allocator<4*1024> pool_block_alloc_4k;
+typedef pooled_block_allocator<8*1024> pool_block_alloc_8k;
+typedef pooled_block_allocator<16*1024> pool_block_alloc_16k;
+typedef pooled_block_allocator<32*1024> pool_block_alloc_32k;
+
+#if defined(USE_ALLOCATOR_POOL)
+
+typedef pool_block_alloc_1k def_block_alloc_1k;
+typedef pool_block_alloc_2k def_block_alloc_2k;
+typedef pool_block_alloc_4k def_block_alloc_4k;
+typedef pool_block_alloc_8k def_block_alloc_8k;
+typedef pool_block_alloc_16k def_block_alloc_16k;
+typedef pool_block_alloc_32k def_block_alloc_32k;
+
+#elif defined(USE_ALLOCATOR_NEW_DELETE)
 
 typedef default_block_allocator_new_delete<1*1024> def_block_alloc_1k;
 typedef default_block_allocator_new_delete<2*1024> def_block_alloc_2k;
@@ -54,15 +122,16 @@ typedef default_block_allocator_malloc_free<32*1024> def_block_alloc_32k;
 
 #endif
 
-template <typename BlockAllocator = def_block_alloc_4k, unsigned MaxBlocks = 4>
+template <typename BlockAllocator = def_block_alloc_4k, unsigned MaxBlocks = 4, typename GrowthPolicy = geometric_growth>
 class BlockBuffer
 {
 public:
     typedef BlockAllocator allocator;
+    typedef GrowthPolicy growth_policy;
     enum { max_blocks = MaxBlocks };
     enum { npos = size_t(-1) };
 
-    BlockBuffer()  { m_maxblocks = max_blocks; m_block = 0; m_size = 0; m_data = NULL; }
+    BlockBuffer()  { m_maxblocks = max_blocks; m_block = 0; m_size = 0; m_data = NULL; m_role = BUFFER_ROLE_OTHER; }
     virtual ~BlockBuffer() { free(); }
 
     inline bool   empty() const	 { return size() == 0; }
@@ -85,51 +154,48 @@ public:
     size_t get_max_blocks() { return m_maxblocks; }
     void set_max_blocks(size_t maxBlocks) { if(maxBlocks > max_blocks) maxBlocks = max_blocks; m_maxblocks = maxBlocks; }
 
-    static size_t current_total_blocks() { return s_current_total_blocks; }
-    static size_t peak_total_blocks()    { return s_peak_total_blocks; }
+    // 用途见BufferRole，用于内存登记的分类，已经分配的容量转到新用途下
+    void set_role(int role);
+    int  get_role() const { return m_role; }
+
+    // 这种缓冲区当前占用的块数，汇总所有线程，见BufferMemory
+    static size_t current_total_blocks() { return BufferMemory::TypeBytes(type_id()) / allocator::requested_size; }
+    static int type_id() { static int id = BufferMemory::RegisterType(typeid(BlockBuffer)); return id; }
 
 protected:
     bool increase_capacity(size_t increase_size);
+    // 已有数据时用ordered_realloc扩展，能原地扩展就不拷贝
+    char * alloc_blocks(size_t newblock) { return m_block > 0 ? allocator::ordered_realloc(m_data, m_block, newblock, m_size) : allocator::ordered_malloc(newblock); }
     char * tail()          { return m_data + m_size; }
     void size(size_t size) { assert(size <= capacity()); m_size = size; }
 
 private:
     void free();
-    static size_t s_current_total_blocks;
-    static size_t s_peak_total_blocks;
 
     char * m_data;
     size_t m_size;
     size_t m_block;
     size_t m_maxblocks;
+    int m_role;
 
     BlockBuffer(const BlockBuffer&);
     void operator = (const BlockBuffer &);
 };
 
-template <typename BlockAllocator, unsigned MaxBlocks>
-size_t BlockBuffer<BlockAllocator, MaxBlocks >::s_current_total_blocks = 0;
-
-template <typename BlockAllocator, unsigned MaxBlocks>
-size_t BlockBuffer<BlockAllocator, MaxBlocks >::s_peak_total_blocks = 0;
-
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline void BlockBuffer<BlockAllocator, MaxBlocks >::free()
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::free()
 {
     if (m_block > 0)
     {
         allocator::ordered_free(m_data, m_block);
-        s_current_total_blocks -= m_block;
-        #ifdef MONITOR
-        g_currentTotalCapacity.fetch_sub(m_block * allocator::requested_size);
-        #endif
+        BufferMemory::Add(type_id(), m_role, -(int64_t)capacity());
         m_data = NULL;
         m_block = 0;
     }
 }
 
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline bool BlockBuffer<BlockAllocator, MaxBlocks >::append(const char * app, size_t len)
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::append(const char * app, size_t len)
 {
     if (len == 0)
         return true; // no data
@@ -143,14 +209,14 @@ inline bool BlockBuffer<BlockAllocator, MaxBlocks >::append(const char * app, si
     return false;
 }
 
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline bool BlockBuffer<BlockAllocator, MaxBlocks >::reserve(size_t n)
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::reserve(size_t n)
 {
     return (n <= capacity() || increase_capacity(n - capacity()));
 }
 
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline bool BlockBuffer<BlockAllocator, MaxBlocks >::resize(size_t n, char c)
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::resize(size_t n, char c)
 {
     if (n > size()) // increase
     {
@@ -163,8 +229,8 @@ inline bool BlockBuffer<BlockAllocator, MaxBlocks >::resize(size_t n, char c)
     return true;
 }
 
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline bool BlockBuffer<BlockAllocator, MaxBlocks >::replace(size_t pos, const char * rep, size_t n)
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::replace(size_t pos, const char * rep, size_t n)
 {
     if (pos >= size()) // out_of_range ?
         return append(rep, n);
@@ -179,8 +245,8 @@ inline bool BlockBuffer<BlockAllocator, MaxBlocks >::replace(size_t pos, const c
     return true;
 }
 
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline void BlockBuffer<BlockAllocator, MaxBlocks >::erase(size_t pos, size_t n, bool hold)
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::erase(size_t pos, size_t n, bool hold)
 {
     assert(pos <= size()); // out_of_range debug.
 
@@ -197,12 +263,23 @@ inline void BlockBuffer<BlockAllocator, MaxBlocks >::erase(size_t pos, size_t n,
         free();
 }
 
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::set_role(int role)
+{
+    if (m_block > 0)
+    {
+        BufferMemory::Add(type_id(), m_role, -(int64_t)capacity());
+        BufferMemory::Add(type_id(), role, (int64_t)capacity());
+    }
+    m_role = role;
+}
+
 /*
 * after success increase_capacity : freespace() >= increase_size
 * if false : does not affect exist data
 */
-template <typename BlockAllocator, unsigned MaxBlocks>
-inline bool BlockBuffer<BlockAllocator, MaxBlocks >::increase_capacity(size_t increase_size)
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool BlockBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::increase_capacity(size_t increase_size)
 {
     if (increase_size == 0) return true;
 
@@ -216,23 +293,18 @@ inline bool BlockBuffer<BlockAllocator, MaxBlocks >::increase_capacity(size_t in
         newblock ++;
 
     if (newblock > m_maxblocks) return false;
-    char * newdata = (char*)(allocator::ordered_malloc(newblock));
-    if (0 == newdata) return false;
-
-    if (m_block > 0)
-    {	// copy old data and free old block
-        memcpy(newdata, m_data, m_size);
-        allocator::ordered_free(m_data, m_block);
-    }
-
-    s_current_total_blocks += newblock - m_block;
-    if (s_current_total_blocks > s_peak_total_blocks){
-        s_peak_total_blocks = s_current_total_blocks;
+    size_t needblock = newblock;
+    newblock = std::min(std::max(growth_policy::grow(m_block, needblock), needblock), m_maxblocks);
+
+    char * newdata = alloc_blocks(newblock);
+    if (0 == newdata && newblock > needblock)
+    {	// 按增长策略分配失败时只要需要的块数
+        newblock = needblock;
+        newdata = alloc_blocks(newblock);
     }
+    if (0 == newdata) return false;
 
-    #ifdef MONITOR
-    g_currentTotalCapacity.fetch_add((uint64_t)(newblock - m_block) * allocator::requested_size);
-    #endif
+    BufferMemory::Add(type_id(), m_role, (int64_t)(newblock - m_block) * allocator::requested_size);
 
     m_data = newdata;
     m_block = newblock;
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <cxxabi.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "buffer_memory.h"
+#include "../sys/thread_mutex.h"
+#include "../sys/locker.h"
+
+using namespace deps;
+
+namespace{
+//每个线程的计数，只有所属线程写，读的时候其他线程可能同时在读，所以用原子变量
+struct Slot{
+    Slot(){
+        for(int i = 0; i < BUFFER_MEMORY_MAX_TYPES; ++i){
+            m_typeBytes[i].store(0, std::memory_order_relaxed);
+        }
+        for(int i = 0; i < BUFFER_ROLE_COUNT; ++i){
+            m_roleBytes[i].store(0, std::memory_order_relaxed);
+        }
+        m_pending = 0;
+    }
+    std::atomic<int64_t> m_typeBytes[BUFFER_MEMORY_MAX_TYPES];
+    std::atomic<int64_t> m_roleBytes[BUFFER_ROLE_COUNT];
+    int64_t m_pending;                  //还没有汇总到全局总量的变化
+};
+
+struct Registry{
+    Registry():m_typeCount(1), m_flushedTotal(0), m_peak(0), m_budget(0), m_pressure(false){
+        m_typeNames[0] = "other";
+        for(int i = 0; i < BUFFER_MEMORY_MAX_TYPES; ++i){
+            m_retiredTypeBytes[i] = 0;
+        }
+        for(int i = 0; i < BUFFER_ROLE_COUNT; ++i){
+            m_retiredRoleBytes[i] = 0;
+        }
+    }
+    ThreadMutex m_mutex;                //保护下面除原子变量以外的成员
+    std::vector<Slot*> m_slots;
+    int64_t m_retiredTypeBytes[BUFFER_MEMORY_MAX_TYPES];    //已经退出的线程的计数
+    int64_t m_retiredRoleBytes[BUFFER_ROLE_COUNT];
+    std::string m_typeNames[BUFFER_MEMORY_MAX_TYPES];
+    std::atomic<int> m_typeCount;
+    std::atomic<int64_t> m_flushedTotal;
+    std::atomic<int64_t> m_peak;
+    std::atomic<int64_t> m_budget;
+    std::atomic<bool> m_pressure;
+    BufferMemory::PressureCallback m_callback;
+};
+
+//缓冲区可能在其他静态对象的析构里释放，登记表不析构
+Registry* GetRegistry(){
+    static Registry* registry = new Registry;
+    return registry;
+}
+
+void Bump(std::atomic<int64_t>& counter, int64_t bytes){
+    counter.store(counter.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+}
+
+void Notify(bool pressure, int64_t used, int64_t budget){
+    Registry* registry = GetRegistry();
+    BufferMemory::PressureCallback callback;
+    {
+        Locker<ThreadMutex> lock(registry->m_mutex);
+        callback = registry->m_callback;
+    }
+    if(callback){
+        callback(pressure, used, budget);
+    }
+}
+
+//把一批变化汇总到全局总量，更新峰值，检查预算
+void Flush(int64_t bytes){
+    Registry* registry = GetRegistry();
+    int64_t total = registry->m_flushedTotal.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = registry->m_peak.load(std::memory_order_relaxed);
+    while(total > peak && !registry->m_peak.compare_exchange_weak(peak, total, std::memory_order_relaxed)){
+    }
+    int64_t budget = registry->m_budget.load(std::memory_order_relaxed);
+    if(budget <= 0){
+        return;
+    }
+    if(total > budget){
+        if(!registry->m_pressure.exchange(true)){
+            Notify(true, total, budget);
+        }
+    }
+    else if(total <= budget - budget / 8 && registry->m_pressure.load(std::memory_order_relaxed)){
+        if(registry->m_pressure.exchange(false)){
+            Notify(false, total, budget);
+        }
+    }
+}
+
+struct SlotHolder{
+    SlotHolder();
+    ~SlotHolder();
+    Slot* m_slot;
+};
+
+thread_local SlotHolder t_slot;
+//线程退出过程中SlotHolder析构之后的变化直接记到已退出线程的计数里
+thread_local bool t_slotDestroyed = false;
+
+SlotHolder::SlotHolder(){
+    m_slot = new Slot;
+    Registry* registry = GetRegistry();
+    Locker<ThreadMutex> lock(registry->m_mutex);
+    registry->m_slots.push_back(m_slot);
+}
+
+SlotHolder::~SlotHolder(){
+    t_slotDestroyed = true;
+    Registry* registry = GetRegistry();
+    int64_t pending = m_slot->m_pending;
+    {
+        Locker<ThreadMutex> lock(registry->m_mutex);
+        for(int i = 0; i < BUFFER_MEMORY_MAX_TYPES; ++i){
+            registry->m_retiredTypeBytes[i] += m_slot->m_typeBytes[i].load(std::memory_order_relaxed);
+        }
+        for(int i = 0; i < BUFFER_ROLE_COUNT; ++i){
+            registry->m_retiredRoleBytes[i] += m_slot->m_roleBytes[i].load(std::memory_order_relaxed);
+        }
+        registry->m_slots.erase(std::find(registry->m_slots.begin(), registry->m_slots.end(), m_slot));
+    }
+    delete m_slot;
+    m_slot = nullptr;
+    if(0 != pending){
+        Flush(pending);
+    }
+}
+}
+
+int BufferMemory::RegisterType(const char* name){
+    Registry* registry = GetRegistry();
+    Locker<ThreadMutex> lock(registry->m_mutex);
+    int count = registry->m_typeCount.load(std::memory_order_relaxed);
+    for(int i = 1; i < count; ++i){
+        if(registry->m_typeNames[i] == name){
+            return i;
+        }
+    }
+    if(count >= BUFFER_MEMORY_MAX_TYPES){
+        return 0;
+    }
+    registry->m_typeNames[count] = name;
+    registry->m_typeCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+int BufferMemory::RegisterType(const std::type_info& type){
+    int status = 0;
+    char* name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if(0 != status || nullptr == name){
+        return RegisterType(type.name());
+    }
+    int id = RegisterType(name);
+    free(name);
+    return id;
+}
+
+void BufferMemory::Add(int type, int role, int64_t bytes){
+    if(type < 0 || type >= BUFFER_MEMORY_MAX_TYPES){
+        type = 0;
+    }
+    if(role < 0 || role >= BUFFER_ROLE_COUNT){
+        role = BUFFER_ROLE_OTHER;
+    }
+    if(t_slotDestroyed){
+        Registry* registry = GetRegistry();
+        {
+            Locker<ThreadMutex> lock(registry->m_mutex);
+            registry->m_retiredTypeBytes[type] += bytes;
+            registry->m_retiredRoleBytes[role] += bytes;
+        }
+        Flush(bytes);
+        return;
+    }
+    Slot* slot = t_slot.m_slot;
+    Bump(slot->m_typeBytes[type], bytes);
+    Bump(slot->m_roleBytes[role], bytes);
+    slot->m_pending += bytes;
+    if(slot->m_pending >= BUFFER_MEMORY_BATCH || slot->m_pending <= -BUFFER_MEMORY_BATCH){
+        int64_t pending = slot->m_pending;
+        slot->m_pending = 0;
+        Flush(pending);
+    }
+}
+
+int64_t BufferMemory::TotalBytes(){
+    int64_t total = 0;
+    for(int i = 0; i < BUFFER_ROLE_COUNT; ++i){
+        total += RoleBytes(i);
+    }
+    return total;
+}
+
+int64_t BufferMemory::TypeBytes(int type){
+    if(type < 0 || type >= BUFFER_MEMORY_MAX_TYPES){
+        return 0;
+    }
+    Registry* registry = GetRegistry();
+    Locker<ThreadMutex> lock(registry->m_mutex);
+    int64_t bytes = registry->m_retiredTypeBytes[type];
+    for(size_t i = 0; i < registry->m_slots.size(); ++i){
+        bytes += registry->m_slots[i]->m_typeBytes[type].load(std::memory_order_relaxed);
+    }
+    return bytes;
+}
+
+int64_t BufferMemory::RoleBytes(int role){
+    if(role < 0 || role >= BUFFER_ROLE_COUNT){
+        return 0;
+    }
+    Registry* registry = GetRegistry();
+    Locker<ThreadMutex> lock(registry->m_mutex);
+    int64_t bytes = registry->m_retiredRoleBytes[role];
+    for(size_t i = 0; i < registry->m_slots.size(); ++i){
+        bytes += registry->m_slots[i]->m_roleBytes[role].load(std::memory_order_relaxed);
+    }
+    return bytes;
+}
+
+const char* BufferMemory::RoleName(int role){
+    static const char* names[BUFFER_ROLE_COUNT] = {"other", "socket_input", "socket_output", "pack"};
+    if(role < 0 || role >= BUFFER_ROLE_COUNT){
+        return "unknown";
+    }
+    return names[role];
+}
+
+void BufferMemory::VisitTypes(const std::function<void(const char* name, int64_t bytes)>& visit){
+    Registry* registry = GetRegistry();
+    int count = registry->m_typeCount.load(std::memory_order_acquire);
+    for(int i = 0; i < count; ++i){
+        std::string name;
+        {
+            Locker<ThreadMutex> lock(registry->m_mutex);
+            name = registry->m_typeNames[i];
+        }
+        visit(name.c_str(), TypeBytes(i));
+    }
+}
+
+int64_t BufferMemory::PeakBytes(){
+    return GetRegistry()->m_peak.load(std::memory_order_relaxed);
+}
+
+void BufferMemory::SetBudget(int64_t bytes, const PressureCallback& callback){
+    Registry* registry = GetRegistry();
+    {
+        Locker<ThreadMutex> lock(registry->m_mutex);
+        registry->m_callback = callback;
+        registry->m_budget.store(bytes, std::memory_order_relaxed);
+        registry->m_pressure.store(false);
+    }
+    //按当前总量马上检查一次
+    Flush(0);
+}
+
+int64_t BufferMemory::GetBudget(){
+    return GetRegistry()->m_budget.load(std::memory_order_relaxed);
+}
+
+bool BufferMemory::UnderPressure(){
+    return GetRegistry()->m_pressure.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <typeinfo>
+#include <functional>
+
+namespace deps{
+#define BUFFER_MEMORY_MAX_TYPES     64              //最多登记的缓冲区类型数，超出的都记到编号0
+#define BUFFER_MEMORY_BATCH         256*1024        //每个线程攒够这么多字节的变化才汇总到全局总量，检查预算和峰值
+
+//缓冲区的用途
+enum BufferRole{
+    BUFFER_ROLE_OTHER = 0,
+    BUFFER_ROLE_SOCKET_INPUT,       //连接的接收缓冲区
+    BUFFER_ROLE_SOCKET_OUTPUT,      //连接的发送队列
+    BUFFER_ROLE_PACK,               //打包用的缓冲区
+    BUFFER_ROLE_COUNT
+};
+
+/**
+ * @brief 全进程的缓冲区内存登记：按缓冲区类型和用途统计占用的字节数。
+ * 每个线程只改自己的计数，不加锁也不和其他线程争用缓存行，读的时候把所有线程的计数加起来；
+ * 在一个线程分配、另一个线程释放时两边的计数一正一负，总和仍然是对的。
+ * 设置预算后，全局总量每攒够BUFFER_MEMORY_BATCH字节的变化检查一次，超过预算时回调pressure=true，
+ * 降到预算的7/8以下时回调pressure=false，可以在回调里停止接受新连接、丢弃低优先级的请求。
+ * 所以预算的检查有延迟，最多差线程数*BUFFER_MEMORY_BATCH字节。
+ */
+class BufferMemory{
+public:
+    typedef std::function<void(bool pressure, int64_t used, int64_t budget)> PressureCallback;
+
+    //登记一种缓冲区类型，返回类型编号；登记满了返回0
+    static int RegisterType(const char* name);
+    static int RegisterType(const std::type_info& type);
+    //type类型、role用途的缓冲区占用变化了bytes字节，可以是负数
+    static void Add(int type, int role, int64_t bytes);
+
+    //当前总量，汇总所有线程的计数
+    static int64_t TotalBytes();
+    static int64_t TypeBytes(int type);
+    static int64_t RoleBytes(int role);
+    static const char* RoleName(int role);
+    //依次访问每种登记过的类型的名字和当前占用
+    static void VisitTypes(const std::function<void(const char* name, int64_t bytes)>& visit);
+    //总量的峰值，按BUFFER_MEMORY_BATCH的粒度记录
+    static int64_t PeakBytes();
+
+    /**
+     * @brief 设置全进程的缓冲区内存预算，0表示不限制。callback在跨过预算的线程里调用，
+     * 调用时可能正在某个缓冲区的扩容里，回调里只应该设置标志或者投递任务，不要直接操作缓冲区。
+     */
+    static void SetBudget(int64_t bytes, const PressureCallback& callback);
+    static int64_t GetBudget();
+    //是否超过了预算，还没有回落到预算的7/8以下
+    static bool UnderPressure();
+};
+}
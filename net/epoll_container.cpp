@@ -6,11 +6,11 @@ using namespace deps;
  * 
  * @param maxFdCount 最大描述符个数
  * @param maxFdEventWaitTime 最长等待事件发生时间
+ * @param edgeTriggered 是否使用边缘触发模式
  */
-EpollContainer::EpollContainer(int maxFdCount, int maxFdEventWaitTime){
-    m_maxFdCount = maxFdCount;
-    m_maxFdEventWaitTime = maxFdEventWaitTime;
-	m_socketNum = 0;
+EpollContainer::EpollContainer(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered)
+    :m_timingWheel(GetMonoTimeMs()){
+    Init(maxFdCount, maxFdEventWaitTime, edgeTriggered);
     
 	//系统多路复用描述符初始化
 #ifdef __APPLE__
@@ -24,148 +24,232 @@ EpollContainer::EpollContainer(int maxFdCount, int maxFdEventWaitTime){
     assert(m_epfd != -1);
 }
 
-EpollContainer::~EpollContainer(){
+//给其他多路复用后端使用，不创建epoll
+EpollContainer::EpollContainer(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered, bool)
+    :m_timingWheel(GetMonoTimeMs()){
+    Init(maxFdCount, maxFdEventWaitTime, edgeTriggered);
+    m_events = nullptr;
+    m_epfd = -1;
 }
 
-bool EpollContainer::AddSocket(SocketBase* s, uint64_t events)
-{
-    if(m_socketMap.size() >= m_maxFdCount){
-        LOG_ERROR("socket container is full");
-        return false;
+void EpollContainer::Init(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered){
+    m_maxFdCount = maxFdCount;
+    m_maxFdEventWaitTime = maxFdEventWaitTime;
+    m_edgeTriggered = edgeTriggered;
+	m_socketNum = 0;
+    m_budget.m_bytes = ET_READ_BUDGET_SIZE;
+    m_busyPollUs = 0;
+    m_socketBusyPollUs = 0;
+    m_loopCount = 0;
+    m_socketPoolSize = SOCKET_POOL_SIZE;
+    m_readyEvents.resize(m_maxFdCount);
+
+    m_wakeupPending = false;
+    m_wakeupTimeUs = 0;
+    m_wakeupRegistered = false;
+#ifdef __APPLE__
+    int ret = pipe(m_wakeupFd);
+    assert(ret == 0);
+    for(int i = 0; i < 2; ++i){
+        int flags = fcntl(m_wakeupFd[i], F_GETFL, 0);
+        fcntl(m_wakeupFd[i], F_SETFL, flags | O_NONBLOCK);
+        fcntl(m_wakeupFd[i], F_SETFD, FD_CLOEXEC);
     }
+#else
+    m_wakeupFd[0] = m_wakeupFd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(m_wakeupFd[0] != -1);
+#endif
+    //generation为0的key不会分配给连接
+    m_wakeupKey = MakeKey(m_wakeupFd[0], 0);
+}
 
-    if(nullptr == s){
-        LOG_ERROR("socket is null");
-        return false;
+EpollContainer::~EpollContainer(){
+    SetSocketPoolSize(0);
+    close(m_wakeupFd[0]);
+    if(m_wakeupFd[1] != m_wakeupFd[0]){
+        close(m_wakeupFd[1]);
     }
-    int fd = s->GetFd();
-    if(m_socketMap.find(fd) != m_socketMap.end()){
-        LOG_ERROR("fd:%d socket:%p already in socket container", fd, s);
-        return false;
+    if(m_epfd != -1){
+        close(m_epfd);
+        m_epfd = -1;
     }
-    
+    delete [] m_events;
+    m_events = nullptr;
+}
+
+bool EpollContainer::CtlSocket(int op, int fd, uint64_t key, uint64_t events){
     int ret = 0;
 #ifdef __APPLE__
+    //Calling close() on a file descriptor will remove any kevents that reference the descriptor
+    if(CTL_DEL == op){
+        return true;
+    }
     //添加或者修改fd，类似epoll_ctl，但kqueue的read/write两个事件是分开的
     struct kevent event[2];
     int n = 0;
-#else
-    uint32_t  epollEvents = 0;
-    struct epoll_event event;
-#endif
-    
+    uint16_t flags = EV_ADD | (m_edgeTriggered ? EV_CLEAR : 0);
     if(SOCKET_EVENT_READ == (events & SOCKET_EVENT_READ)){
-    #ifdef __APPLE__
         //添加Read事件，EVFILT_READ表示READ事件，操作为添加或者打开，多次重复操作没有副作用
-        EV_SET(&event[n++], fd, EVFILT_READ, EV_ADD, 0, 0, (void*)(intptr_t)fd);
-    #else
-        epollEvents = EPOLLIN;
-    #endif
+        EV_SET(&event[n++], fd, EVFILT_READ, flags, 0, 0, (void*)(intptr_t)key);
+    }
+    else if(CTL_MOD == op){
+        EV_SET(&event[n++], fd, EVFILT_READ, EV_DELETE, 0, 0, (void*)(intptr_t)key);
     }
     if(SOCKET_EVENT_WRITE == (events & SOCKET_EVENT_WRITE)){
-    #ifdef __APPLE__
-        EV_SET(&event[n++], fd, EVFILT_WRITE, EV_ADD, 0, 0, (void*)(intptr_t)fd);
-    #else
-        epollEvents == 0 ? epollEvents = EPOLLOUT : epollEvents |= EPOLLOUT;
-    #endif
+        EV_SET(&event[n++], fd, EVFILT_WRITE, flags, 0, 0, (void*)(intptr_t)key);
     }
-    if(SOCKET_EVENT_ERROR == (events & SOCKET_EVENT_ERROR)){
-    #ifdef __APPLE__
-    #else
-        epollEvents == 0 ? epollEvents = EPOLLERR : epollEvents |= EPOLLERR;
-    #endif
+    else if(CTL_MOD == op){
+        EV_SET(&event[n++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, (void*)(intptr_t)key);
     }
-#ifdef __APPLE__
     //调用kevent，应用更改
     ret = kevent(m_epfd, event, n, NULL, 0, NULL);
+    if(-1 == ret && CTL_MOD == op && ENOENT == errno){
+        //The event could not be found to be modified or deleted.
+        ret = 0;
+    }
 #else
+    if(CTL_DEL == op){
+        return 0 == epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    struct epoll_event event;
+    uint32_t  epollEvents = 0;
+    if(SOCKET_EVENT_READ == (events & SOCKET_EVENT_READ)){
+        epollEvents |= EPOLLIN;
+    }
+    if(SOCKET_EVENT_WRITE == (events & SOCKET_EVENT_WRITE)){
+        epollEvents |= EPOLLOUT;
+    }
+    if(SOCKET_EVENT_ERROR == (events & SOCKET_EVENT_ERROR)){
+        epollEvents |= EPOLLERR;
+    }
+    if(m_edgeTriggered){
+        epollEvents |= EPOLLET;
+    }
+#ifdef EPOLLEXCLUSIVE
+    //EPOLLEXCLUSIVE只能在EPOLL_CTL_ADD时使用，MOD时会返回EINVAL
+    if(CTL_ADD == op && SOCKET_EVENT_EXCLUSIVE == (events & SOCKET_EVENT_EXCLUSIVE)){
+        epollEvents |= EPOLLEXCLUSIVE;
+    }
+#endif
     event.events = epollEvents;
-    event.data.fd = fd;
-    ret = epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &event);
+    event.data.u64 = key;
+    ret = epoll_ctl(m_epfd, CTL_ADD == op ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
 #endif
-    if ( -1 == ret ){
-        LOG_DEBUG("fd:%d socket:%p add events:%llx failed", fd, s, events);
-        return false;
+    return -1 != ret;
+}
+
+int EpollContainer::WaitEvents(int waitTime){
+    int ready = 0; 
+    #ifdef __APPLE__
+    struct timespec timeout;
+    timeout.tv_sec = waitTime / 1000;
+    timeout.tv_nsec = (waitTime % 1000) * 1000000;
+    ready = kevent(m_epfd, NULL, 0, m_events, m_maxFdCount, &timeout);
+    #else
+    ready = epoll_wait(m_epfd, m_events, m_maxFdCount, waitTime);
+    #endif
+
+    if (ready == -1) {
+        if(errno != EINTR){
+            LOG_ERROR("%s",strerror(errno));
+        }
+        return 0;
     }
-    LOG_DEBUG("fd:%d socket:%p add events:%llx success", fd, s, events);
-    m_socketMap[fd] = s;
-	m_socketNum++;
-    return true;
+    for (int i = 0; i < ready; ++i) {
+        ReadyEvent& ev = m_readyEvents[i];
+        ev.m_events = 0;
+        #ifdef __APPLE__
+        ev.m_key = (uint64_t)(intptr_t)m_events[i].udata;
+        if (EVFILT_READ == m_events[i].filter) {
+            ev.m_events = SOCKET_EVENT_READ;
+        } else if (EVFILT_WRITE == m_events[i].filter) {
+            ev.m_events = SOCKET_EVENT_WRITE;
+        }
+        #else
+        ev.m_key = m_events[i].data.u64;
+        if (EPOLLERR == (m_events[i].events & EPOLLERR)) {
+            ev.m_events |= SOCKET_EVENT_ERROR;
+        }
+        if(EPOLLIN == (m_events[i].events & EPOLLIN)){
+            ev.m_events |= SOCKET_EVENT_READ;
+        }
+        if(EPOLLOUT == (m_events[i].events & EPOLLOUT)){
+            ev.m_events |= SOCKET_EVENT_WRITE;
+        }
+        #endif
+    }
+    return ready;
 }
 
-bool EpollContainer::ModSocket(SocketBase* s, uint64_t events)
+bool EpollContainer::AddSocket(SocketBase* s, uint64_t events)
 {
+    if(m_socketNum >= m_maxFdCount){
+        LOG_ERROR("socket container is full");
+        return false;
+    }
+
     if(nullptr == s){
         LOG_ERROR("socket is null");
         return false;
     }
     int fd = s->GetFd();
-    if(m_socketMap.find(fd) == m_socketMap.end()){
-        LOG_ERROR("fd:%d socket:%p not in socket container", fd, s);
+    if(fd < 0){
+        LOG_ERROR("fd:%d socket:%p invalid fd", fd, s);
         return false;
     }
-    int ret = 0;
-    #ifdef __APPLE__
-    struct kevent event[2];
-    int n = 0;
-    #else
-    struct epoll_event event;
-    uint32_t  epollEvents = 0;
-    #endif
-
-    if(SOCKET_EVENT_READ == (events & SOCKET_EVENT_READ)){
-    #ifdef __APPLE__
-        EV_SET(&event[n++], fd, EVFILT_READ, EV_ADD, 0, 0, (void*)(intptr_t)fd);
-    #else
-        epollEvents = EPOLLIN;
-    #endif
+    if((size_t)fd >= m_sockets.size()){
+        //描述符是连续的小整数，按倍数扩容
+        size_t size = m_sockets.empty() ? 1024 : m_sockets.size();
+        while(size <= (size_t)fd){
+            size *= 2;
+        }
+        m_sockets.resize(size);
     }
-    else{
-    #ifdef __APPLE__
-        EV_SET(&event[n++], fd, EVFILT_READ, EV_DELETE, 0, 0, (void*)(intptr_t)fd);
-    #endif
+    SocketSlot& slot = m_sockets[fd];
+    if(nullptr != slot.m_socket){
+        LOG_ERROR("fd:%d socket:%p already in socket container", fd, s);
+        return false;
     }
-
-    if(SOCKET_EVENT_WRITE == (events & SOCKET_EVENT_WRITE)){
-    #ifdef __APPLE__
-        EV_SET(&event[n++], fd, EVFILT_WRITE, EV_ADD, 0, 0, (void*)(intptr_t)fd);
-    #else
-        epollEvents == 0 ? epollEvents = EPOLLOUT : epollEvents |= EPOLLOUT;
-    #endif
+    uint32_t generation = slot.m_generation + 1;
+    if(0 == generation){
+        //generation为0的key留给唤醒描述符
+        generation = 1;
     }
-    else{
-    #ifdef __APPLE__
-        EV_SET(&event[n++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, (void*)(intptr_t)fd);
-    #endif
+    uint64_t key = MakeKey(fd, generation);
+    if(!CtlSocket(CTL_ADD, fd, key, events)){
+        LOG_DEBUG("fd:%d socket:%p add events:%llx failed", fd, s, (unsigned long long)events);
+        return false;
     }
-
-    if(SOCKET_EVENT_ERROR == (events & SOCKET_EVENT_ERROR)){
-    #ifdef __APPLE__
-    #else
-        epollEvents == 0 ? epollEvents = EPOLLERR : epollEvents |= EPOLLERR;
-    #endif
+    LOG_DEBUG("fd:%d socket:%p add events:%llx success", fd, s, (unsigned long long)events);
+    slot.m_socket = s;
+    slot.m_generation = KeyGeneration(key);
+    s->SetId(key);
+    slot.m_pendingEvents = 0;
+    slot.m_flushPending = false;
+	m_socketNum++;
+    if(m_socketBusyPollUs > 0){
+        SetSocketBusyPoll(fd);
     }
+    return true;
+}
 
-#ifdef __APPLE__
-    ret = kevent(m_epfd, event, n, NULL, 0, NULL);
-#else
-    event.events = epollEvents;
-    event.data.fd = fd;
-    ret = epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &event);
-#endif
-
-    if ( -1 == ret ){
-        #ifdef __APPLE__
-        if(ENOENT != errno){//The event could not be found to be modified or deleted.
-            LOG_ERROR("fd:%d socket:%p mod events:%llx failed %s", fd, s, events, strerror(errno));
-            return false;
-        }
-        #else
-        LOG_ERROR("fd:%d socket:%p mod events:%llx failed %s", fd, s, events, strerror(errno));
+bool EpollContainer::ModSocket(SocketBase* s, uint64_t events)
+{
+    if(nullptr == s){
+        LOG_ERROR("socket is null");
         return false;
-        #endif
     }
-    LOG_DEBUG("fd:%d socket:%p mod events:%llx success", fd, s, events);
+    int fd = s->GetFd();
+    if(GetSocket(fd) != s){
+        LOG_ERROR("fd:%d socket:%p not in socket container", fd, s);
+        return false;
+    }
+    uint64_t key = MakeKey(fd, m_sockets[fd].m_generation);
+    if(!CtlSocket(CTL_MOD, fd, key, events)){
+        LOG_ERROR("fd:%d socket:%p mod events:%llx failed %s", fd, s, (unsigned long long)events, strerror(errno));
+        return false;
+    }
+    LOG_DEBUG("fd:%d socket:%p mod events:%llx success", fd, s, (unsigned long long)events);
     return true;
 }
 
@@ -175,18 +259,15 @@ bool EpollContainer::DelSocket(SocketBase* s)
         return true;
     }
     int fd = s->GetFd();
-    //事件容器中删除描述符 
-    #ifdef __APPLE__
-    //Calling close() on a file descriptor will remove any kevents that reference the descriptor
-    // struct kevent event[2];
-    #else
-    epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
-    #endif
-    auto itr = m_socketMap.find(fd);
-    if(itr != m_socketMap.end()){
-        m_socketMap.erase(itr);
+    if(GetSocket(fd) == s){
+        //事件容器中删除描述符 
+        CtlSocket(CTL_DEL, fd, MakeKey(fd, m_sockets[fd].m_generation), 0);
+        m_sockets[fd].m_socket = nullptr;
+        m_sockets[fd].m_pendingEvents = 0;
+        m_sockets[fd].m_flushPending = false;
         m_socketNum--;
     }
+    m_timingWheel.Del(s->GetTimer());
     m_closeSockets.insert(s);
 
     LOG_DEBUG("fd:%d socket:%p rm events",fd, s);
@@ -194,92 +275,368 @@ bool EpollContainer::DelSocket(SocketBase* s)
 }
 
 SocketBase* EpollContainer::GetSocket(int fd){
-    auto itr = m_socketMap.find(fd);
-    if(itr == m_socketMap.end()){
+    if(fd < 0 || (size_t)fd >= m_sockets.size()){
         return nullptr;
     }
-    return itr->second;
+    return m_sockets[fd].m_socket;
+}
+
+SocketBase* EpollContainer::GetSocket(uint64_t key){
+    int fd = KeyFd(key);
+    if(fd < 0 || (size_t)fd >= m_sockets.size()){
+        return nullptr;
+    }
+    const SocketSlot& slot = m_sockets[fd];
+    if(slot.m_generation != KeyGeneration(key)){
+        return nullptr;
+    }
+    return slot.m_socket;
 }
 
 void EpollContainer::HandleSockets(){
+    if(!m_wakeupRegistered){
+        //后端的CtlSocket是虚函数，只能在构造完成后注册
+        m_wakeupRegistered = CtlSocket(CTL_ADD, m_wakeupFd[0], m_wakeupKey, SOCKET_EVENT_READ);
+        if(!m_wakeupRegistered){
+            LOG_ERROR("wakeup fd:%d add events failed %s", m_wakeupFd[0], strerror(errno));
+        }
+    }
+    RunPostTasks();
     CheckCloseSocket();
-    CheckTimeoutSocket();
+    CheckTimer();
+    //任务和定时器里攒下的数据在等待之前发出去
+    FlushSockets();
+    //还有没处理完的连接就不阻塞等待
+    int waitTime = m_pendingSockets.empty() ? m_maxFdEventWaitTime : 0;
+    //最近的定时器比等待时间先到期时只等到定时器到期
+    if(0 != waitTime && m_timingWheel.Size() > 0){
+        uint64_t next = m_timingWheel.NextExpireMs();
+        uint64_t now = GetMonoTimeMs();
+        uint64_t delay = next > now ? next - now : 0;
+        if(waitTime < 0 || delay < (uint64_t)waitTime){
+            waitTime = (int)delay;
+        }
+    }
     //事件容器里拿出所有描述符
-    int ready = 0; 
-    #ifdef __APPLE__
-    struct timespec timeout;
-    timeout.tv_sec = m_maxFdEventWaitTime / 1000;
-    timeout.tv_nsec = (m_maxFdEventWaitTime % 1000) * 1000;
-    ready = kevent(m_epfd, NULL, 0, m_events, m_maxFdCount, &timeout);
-    #else
-    ready = epoll_wait(m_epfd, m_events, m_maxFdCount, m_maxFdEventWaitTime);
-    #endif
+    int ready = PollEvents(waitTime);
 
-    if (ready == -1) {
-        LOG_ERROR("%s",strerror(errno));
+    //上一轮因为公平预算用完而没处理完的连接，放到本轮就绪事件之后处理
+    m_processingSockets.clear();
+    for(size_t i = 0; i < m_pendingSockets.size(); ++i){
+        uint64_t key = m_pendingSockets[i];
+        if(nullptr == GetSocket(key)){
+            continue;
+        }
+        SocketSlot& slot = m_sockets[KeyFd(key)];
+        m_processingSockets.push_back(std::make_pair(key, slot.m_pendingEvents));
+        slot.m_pendingEvents = 0;
     }
+    m_pendingSockets.clear();
+    m_stats.m_pendingSocketCount.fetch_add(m_processingSockets.size(), std::memory_order_relaxed);
     //处理每个描述符
     for (int i = 0; i < ready; ++i) {
-        int fd = -1;
-
-        #ifdef __APPLE__
-        fd = (int)(intptr_t)m_events[i].udata;
-        #else
-        fd = m_events[i].data.fd;
-        #endif
+        uint64_t key = m_readyEvents[i].m_key;
+        uint64_t events = m_readyEvents[i].m_events;
+        int fd = KeyFd(key);
+        if(key == m_wakeupKey){
+            //投递的任务在下一轮开始时处理
+            ClearWakeup();
+            continue;
+        }
         
-        SocketBase *s = GetSocket(fd);//连接容器里获取描述符对应的连接
-        //出现连接容器和事件容器里描述符不一致,出现逻辑bug
+        SocketBase *s = GetSocket(key);//连接容器里获取描述符对应的连接
+        //本轮前面的事件处理中连接已经关闭(描述符可能已经被新连接复用)，事件已经失效
         if (nullptr == s) {
-            LOG_ERROR("fd:%d socket:%p not in socket container",fd,s);
+            LOG_DEBUG("fd:%d generation:%u stale event", fd, KeyGeneration(key));
+            if(SOCKET_EVENT_ACCEPT == (events & SOCKET_EVENT_ACCEPT)){
+                //监听连接已经关闭，后端接收的新连接直接关闭
+                close(m_readyEvents[i].m_result);
+            }
+            continue;
+        }
+
+        if(SOCKET_EVENT_ACCEPT == (events & SOCKET_EVENT_ACCEPT)){
+            s->HandleAccept(m_readyEvents[i].m_result);
+            continue;
+        }
+        if(SOCKET_EVENT_RECV == (events & SOCKET_EVENT_RECV)){
+            s->HandleRecv(m_readyEvents[i].m_data, m_readyEvents[i].m_result);
+            continue;
+        }
+        if(SOCKET_EVENT_SEND_DONE == (events & SOCKET_EVENT_SEND_DONE)){
+            s->HandleSendComplete(m_readyEvents[i].m_result);
             continue;
         }
         
-        #ifdef __APPLE__
-        if (EVFILT_READ == m_events[i].filter) {
-            LOG_DEBUG("fd:%d socket:%p kqueue read events:%d",fd, s, m_events[i].filter);
+        if (SOCKET_EVENT_ERROR == (events & SOCKET_EVENT_ERROR)) {
+            LOG_DEBUG("fd:%d socket:%p events:%llx", fd, s, (unsigned long long)events);
+            s->HandleError();
+            //错误事件也可能只是错误队列里的通知(例如零拷贝发送完成)，连接还在就继续处理读写
+            if(GetSocket(key) != s){
+                continue;
+            }
+        }
+
+        if(SOCKET_EVENT_READ == (events & SOCKET_EVENT_READ)){
+            LOG_DEBUG("fd:%d socket:%p read events:%llx", fd, s, (unsigned long long)events);
             s->HandleRead(m_maxReadBuffer, MAX_READ_BUFF_SIZE);
-        } else if (EVFILT_WRITE == m_events[i].filter) {
-            LOG_DEBUG("fd:%d socket:%p kqueue write events:%d",fd, s, m_events[i].filter);
+        }
+
+        if(SOCKET_EVENT_WRITE == (events & SOCKET_EVENT_WRITE) && GetSocket(key) == s){
+            LOG_DEBUG("fd:%d socket:%p write events:%llx", fd, s, (unsigned long long)events);
             s->HandleWrite();
         }
-        #else
-        if (EPOLLERR == (m_events[i].events & EPOLLERR)) {
-            LOG_ERROR("fd:%d socket:%p epoll events:%x",fd, s, m_events[i].events);
-            s->HandleError();
+    }
+
+    for(size_t i = 0; i < m_processingSockets.size(); ++i){
+        uint64_t key = m_processingSockets[i].first;
+        uint32_t events = m_processingSockets[i].second;
+        SocketBase *s = GetSocket(key);
+        if(nullptr == s){
             continue;
         }
-
-        if(EPOLLIN == (m_events[i].events & EPOLLIN)){
-            LOG_DEBUG("fd:%d socket:%p epoll read events:%x",fd, s, m_events[i].events);
+        LOG_DEBUG("fd:%d socket:%p pending events:%x", KeyFd(key), s, events);
+        if(SOCKET_EVENT_READ == (events & SOCKET_EVENT_READ)){
             s->HandleRead(m_maxReadBuffer, MAX_READ_BUFF_SIZE);
         }
-
-        if(EPOLLOUT == (m_events[i].events & EPOLLOUT)){
-            LOG_DEBUG("fd:%d socket:%p epoll write events:%x",fd, s, m_events[i].events);
+        if(SOCKET_EVENT_WRITE == (events & SOCKET_EVENT_WRITE) && GetSocket(key) == s){
             s->HandleWrite();
         }
-        #endif
     }
+
+    FlushSockets();
+}
+
+void EpollContainer::AddFlushSocket(SocketBase* s){
+    if(nullptr == s || GetSocket(s->GetFd()) != s){
+        return;
+    }
+    SocketSlot& slot = m_sockets[s->GetFd()];
+    if(!slot.m_flushPending){
+        slot.m_flushPending = true;
+        m_flushSockets.push_back(MakeKey(s->GetFd(), slot.m_generation));
+    }
+}
+
+void EpollContainer::FlushSockets(){
+    if(m_flushSockets.empty()){
+        return;
+    }
+    //回调里可能再次登记，先换出来
+    m_flushingSockets.swap(m_flushSockets);
+    for(size_t i = 0; i < m_flushingSockets.size(); ++i){
+        uint64_t key = m_flushingSockets[i];
+        SocketBase *s = GetSocket(key);
+        if(nullptr == s){
+            continue;
+        }
+        m_sockets[KeyFd(key)].m_flushPending = false;
+        s->HandleFlush();
+    }
+    m_flushingSockets.clear();
 }
 
-void EpollContainer::CheckTimeoutSocket(){
-    //设置了业务层面的心跳超时检测
-    static int checkFd = 0;
-    auto itr = m_socketMap.upper_bound(checkFd);
-    int checkCnt = 0;
-    while(itr != m_socketMap.end() && checkCnt < 1000){
-        checkFd = itr->first;
-        SocketBase* s = itr->second;
-        if(nullptr != s){
-            s->HandleTimeout();
+bool EpollContainer::IsEdgeTriggered(){
+    return m_edgeTriggered;
+}
+
+void EpollContainer::AddPendingSocket(SocketBase* s, uint64_t events){
+    if(nullptr == s || GetSocket(s->GetFd()) != s){
+        return;
+    }
+    SocketSlot& slot = m_sockets[s->GetFd()];
+    if(0 == slot.m_pendingEvents){
+        m_pendingSockets.push_back(MakeKey(s->GetFd(), slot.m_generation));
+    }
+    slot.m_pendingEvents |= (uint32_t)events;
+}
+
+void EpollContainer::CheckTimer(){
+    //只回调到期的定时器，连接超时在回调里处理
+    m_timingWheel.Expire(GetMonoTimeMs());
+}
+
+void EpollContainer::AddTimer(TimerNode* node, uint64_t timeoutMs){
+    m_timingWheel.Add(node, GetMonoTimeMs() + timeoutMs);
+}
+
+void EpollContainer::DelTimer(TimerNode* node){
+    m_timingWheel.Del(node);
+}
+
+bool EpollContainer::Post(const std::function<void()>& task){
+    if(!task){
+        return false;
+    }
+    {
+        Locker<ThreadMutex> lock(m_inboxMutex);
+        m_inbox.push_back(task);
+    }
+    //唤醒时间要在设置标记之前写好，事件循环看到标记时读到的时间才有效；并发投递时可能记成稍晚的时间
+    if(!m_wakeupPending.load()){
+        m_wakeupTimeUs.store(GetMonoTimeUs());
+    }
+    //收件箱从空变成非空后只需要唤醒一次
+    if(!m_wakeupPending.exchange(true)){
+    #ifdef __APPLE__
+        char c = 1;
+        int n = write(m_wakeupFd[1], &c, sizeof(c));
+    #else
+        uint64_t one = 1;
+        int n = write(m_wakeupFd[1], &one, sizeof(one));
+    #endif
+        if(n < 0 && errno != EAGAIN){
+            LOG_ERROR("wakeup fd:%d write failed %s", m_wakeupFd[1], strerror(errno));
+        }
+    }
+    return true;
+}
+
+bool EpollContainer::PostPacket(uint64_t socketId, const char* data, size_t size){
+    if(nullptr == data || size < 1){
+        return true;
+    }
+    //数据只在这里拷贝一次，之后连同所有权一起交给连接的发送队列
+    std::shared_ptr<std::string> packet = std::make_shared<std::string>(data, size);
+    return Post([this, socketId, packet](){
+        SocketBase* s = GetSocket(socketId);
+        if(nullptr == s){
+            LOG_DEBUG("fd:%d socket closed, drop packet size:%zu", KeyFd(socketId), packet->size());
+            return;
+        }
+        s->SendPacket(packet->data(), packet->size(), [packet](){});
+    });
+}
+
+ContainerStats& EpollContainer::GetStats(){
+    return m_stats;
+}
+
+void EpollContainer::EnableBusyPoll(uint32_t spinUs, uint32_t socketBusyPollUs){
+    m_busyPollUs = spinUs;
+    m_socketBusyPollUs = spinUs > 0 ? socketBusyPollUs : 0;
+    //已经在容器里的连接也设置上
+    for(size_t fd = 0; m_socketBusyPollUs > 0 && fd < m_sockets.size(); ++fd){
+        if(nullptr != m_sockets[fd].m_socket){
+            SetSocketBusyPoll(fd);
         }
-        ++checkCnt;
-        ++itr;
     }
-    if(itr == m_socketMap.end()){
-        checkFd = 0;
+}
+
+int EpollContainer::PollEvents(int waitTime){
+    if(0 == ++m_loopCount % 1024){
+        UpdateLoopCpuTime();
+    }
+    if(0 == waitTime){
+        return WaitEvents(0);
+    }
+    if(m_busyPollUs > 0){
+        uint64_t spinUs = std::min((uint64_t)m_busyPollUs, (uint64_t)waitTime * 1000);
+        uint64_t start = GetMonoTimeUs();
+        do{
+            int ready = WaitEvents(0);
+            m_stats.m_busyPollCalls.fetch_add(1, std::memory_order_relaxed);
+            if(ready != 0){
+                if(ready > 0){
+                    m_stats.m_busyPollHits.fetch_add(1, std::memory_order_relaxed);
+                }
+                return ready;
+            }
+        }while(GetMonoTimeUs() - start < spinUs);
+    }
+    UpdateLoopCpuTime();
+    m_stats.m_blockingWaits.fetch_add(1, std::memory_order_relaxed);
+    return WaitEvents(waitTime);
+}
+
+void EpollContainer::SetSocketBusyPoll(int fd){
+#ifdef SO_BUSY_POLL
+    int us = m_socketBusyPollUs;
+    if(-1 == setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us))){
+        LOG_DEBUG("fd:%d set SO_BUSY_POLL:%d failed %s", fd, us, strerror(errno));
+        return;
+    }
+#ifdef SO_PREFER_BUSY_POLL
+    int one = 1;
+    if(-1 == setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one))){
+        LOG_DEBUG("fd:%d set SO_PREFER_BUSY_POLL failed %s", fd, strerror(errno));
+    }
+#endif
+#endif
+}
+
+void EpollContainer::UpdateLoopCpuTime(){
+    struct timespec ts;
+    if(0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)){
+        m_stats.m_loopCpuUs.store((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000, std::memory_order_relaxed);
+    }
+}
+
+void EpollContainer::SetSocketPoolSize(size_t size){
+    m_socketPoolSize = size;
+    for(int i = 0; i < 2; ++i){
+        while(m_socketPool[i].size() > size){
+            delete m_socketPool[i].back();
+            m_socketPool[i].pop_back();
+        }
+    }
+}
+
+SocketBase* EpollContainer::AcquireSocket(SocketType type){
+    std::vector<SocketBase*>& pool = m_socketPool[(int)type];
+    if(pool.empty()){
+        m_stats.m_socketPoolMisses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    m_stats.m_socketPoolHits.fetch_add(1, std::memory_order_relaxed);
+    SocketBase* s = pool.back();
+    pool.pop_back();
+    return s;
+}
+
+bool EpollContainer::HasRecvCompletion(){
+    return false;
+}
+
+bool EpollContainer::SubmitSend(SocketBase* s, const struct iovec* iov, int iovcnt){
+    return false;
+}
+
+void EpollContainer::SetBudget(const SocketBudget& budget){
+    m_budget = budget;
+}
+
+const SocketBudget& EpollContainer::GetBudget(){
+    return m_budget;
+}
+
+void EpollContainer::ClearWakeup(){
+    #ifdef __APPLE__
+    char buf[256];
+    while(read(m_wakeupFd[0], buf, sizeof(buf)) > 0){
+    }
+    #else
+    uint64_t count = 0;
+    int n = read(m_wakeupFd[0], &count, sizeof(count));
+    (void)n;
+    #endif
+}
+
+void EpollContainer::RunPostTasks(){
+    if(!m_wakeupPending.load()){
+        return;
+    }
+    m_stats.m_wakeupLatency.Record(GetMonoTimeUs() - m_wakeupTimeUs.load());
+    //先清标记再取任务，之后投递的任务会重新唤醒
+    m_wakeupPending.store(false);
+    {
+        Locker<ThreadMutex> lock(m_inboxMutex);
+        m_runningTasks.swap(m_inbox);
+    }
+    for(size_t i = 0; i < m_runningTasks.size(); ++i){
+        m_runningTasks[i]();
     }
+    m_runningTasks.clear();
 }
 
 void EpollContainer::CheckCloseSocket(){
@@ -287,6 +644,12 @@ void EpollContainer::CheckCloseSocket(){
 		it != m_closeSockets.end(); ++it){
 		SocketBase* pSock = *it;
 		if(pSock != nullptr){
+            std::vector<SocketBase*>& pool = m_socketPool[(int)pSock->GetType()];
+            if(pool.size() < m_socketPoolSize && pSock->Recycle()){
+                LOG_DEBUG("recycle socket:%p", pSock);
+                pool.push_back(pSock);
+                continue;
+            }
 			LOG_DEBUG("delete socket:%p fd:%d", pSock, pSock->GetFd());
 			delete pSock;
 		}
@@ -2,7 +2,11 @@
 
 #include <string>
 #include <set>
-#include <map>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -19,39 +23,133 @@
     #include <sys/event.h>
 #else
     #include <sys/epoll.h>
+    #include <sys/eventfd.h>
 #endif
 
 #include "../sys/log.h"
+#include "../sys/util.h"
+#include "../sys/locker.h"
+#include "../sys/thread_mutex.h"
 #include "socket_base.h"
 #include "socket_container.h"
 
 namespace deps{
 class EpollContainer : public SocketContainer{
 public:
-	EpollContainer(int maxFdCount, int maxFdEventWaitTime);
+	EpollContainer(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered = false);
 	virtual ~EpollContainer();
     virtual bool AddSocket(SocketBase* s, uint64_t events);
     virtual bool ModSocket(SocketBase* s, uint64_t events);
     virtual bool DelSocket(SocketBase* s);
     virtual void HandleSockets();
 	virtual int  SocketNum();
+    virtual bool IsEdgeTriggered();
+    virtual void AddPendingSocket(SocketBase* s, uint64_t events);
+    virtual void AddFlushSocket(SocketBase* s);
+    virtual void AddTimer(TimerNode* node, uint64_t timeoutMs);
+    virtual void DelTimer(TimerNode* node);
+    virtual bool Post(const std::function<void()>& task);
+    virtual bool PostPacket(uint64_t socketId, const char* data, size_t size);
+    virtual ContainerStats& GetStats();
+    virtual void SetBudget(const SocketBudget& budget);
+    virtual const SocketBudget& GetBudget();
+    virtual SocketBase* AcquireSocket(SocketType type);
+    virtual bool HasRecvCompletion();
+    virtual bool SubmitSend(SocketBase* s, const struct iovec* iov, int iovcnt);
 
     SocketBase* GetSocket(int fd);
+    /**
+     * @brief 忙轮询模式：没有事件时先用0超时反复WaitEvents最多spinUs微秒，还没有事件再阻塞等待，
+     * 用cpu换唤醒延迟。socketBusyPollUs大于0时给容器里的连接设置SO_BUSY_POLL和SO_PREFER_BUSY_POLL，
+     * 让内核在收包时也忙轮询网卡队列(超过net.core.busy_read需要CAP_NET_ADMIN，失败时忽略)。
+     * spinUs为0表示关闭。只能在事件循环线程里或者事件循环启动之前调用。
+     * 效果看GetStats()里的m_wakeupLatency和m_loopCpuUs。
+     */
+    void EnableBusyPoll(uint32_t spinUs, uint32_t socketBusyPollUs = BUSY_POLL_SOCKET_US);
+    //回收池里每种连接对象最多保留的个数，0表示不回收，多出来的对象立即释放
+    void SetSocketPoolSize(size_t size);
+protected:
+    enum { CTL_ADD = 1, CTL_MOD = 2, CTL_DEL = 3 };
+    //就绪事件，m_events是SOCKET_EVENT_*的组合；
+    //完成事件(SOCKET_EVENT_RECV/ACCEPT/SEND_DONE)每个单独一项，m_result是结果，m_data是收到的数据
+    struct ReadyEvent{
+        uint64_t m_key;
+        uint64_t m_events;
+        const char* m_data;
+        int m_result;
+    };
+    //给其他多路复用后端使用的构造函数，不创建epoll
+    EpollContainer(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered, bool noPoller);
+    //多路复用后端：添加、修改、删除描述符关注的事件
+    virtual bool CtlSocket(int op, int fd, uint64_t key, uint64_t events);
+    //多路复用后端：最多等待waitTime毫秒，就绪事件放到m_readyEvents，返回就绪个数
+    virtual int WaitEvents(int waitTime);
+    //事件里携带的key：高32位是generation，低32位是描述符
+    static uint64_t MakeKey(int fd, uint32_t generation){return ((uint64_t)generation << 32) | (uint32_t)fd;}
+    static int KeyFd(uint64_t key){return (int)(uint32_t)key;}
+    static uint32_t KeyGeneration(uint64_t key){return (uint32_t)(key >> 32);}
+    //key对应的连接，连接已经关闭或者描述符已经被复用时返回nullptr
+    SocketBase* GetSocket(uint64_t key);
 private:
-    void CheckTimeoutSocket();
+    void Init(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered);
+    //描述符直接索引的连接槽，generation每次有新连接占用时加1，用来识别已经失效的事件
+    struct SocketSlot{
+        SocketSlot():m_socket(nullptr), m_generation(0), m_pendingEvents(0), m_flushPending(false){}
+        SocketBase* m_socket;
+        uint32_t m_generation;
+        uint32_t m_pendingEvents;   //公平预算用完还没处理完的事件
+        bool m_flushPending;        //已经登记了本轮末尾的HandleFlush
+    };
+    void CheckTimer();
 	void CheckCloseSocket();
-private:
+    //执行收件箱里其他线程投递的任务
+    void RunPostTasks();
+    //回调登记过的连接的HandleFlush
+    void FlushSockets();
+    //清掉唤醒描述符上的通知
+    void ClearWakeup();
+    //按是否忙轮询等待事件
+    int PollEvents(int waitTime);
+    void SetSocketBusyPoll(int fd);
+    //更新事件循环线程占用的cpu时间
+    void UpdateLoopCpuTime();
+protected:
 	int m_maxFdCount;//进程能够打开的描述符最大个数
-    std::map<int, SocketBase*> m_socketMap;
+    int m_maxFdEventWaitTime; //等待事件发生的最长时间(单位是毫秒)
+    bool m_edgeTriggered;   //是否边缘触发模式
+    std::vector<ReadyEvent> m_readyEvents;  //WaitEvents得到的就绪事件
+    uint64_t m_wakeupKey;               //唤醒描述符在事件里的key
+private:
+    std::vector<SocketSlot> m_sockets;  //按描述符索引的连接表
     int m_epfd;    //管理描述符对应事件的容器
 #ifdef __APPLE__
     struct kevent *m_events;
 #else  
     struct epoll_event *m_events;
 #endif
-    int m_maxFdEventWaitTime; //等待事件发生的最长时间(单位是毫秒)
 	std::set<SocketBase*> m_closeSockets;
 	int m_socketNum;
+    TimingWheel m_timingWheel;  //连接超时等定时器
+    std::vector<uint64_t> m_pendingSockets;     //公平预算用完还没处理完的连接
+    std::vector<std::pair<uint64_t, uint32_t> > m_processingSockets; //本轮要继续处理的连接及其事件
+    std::vector<uint64_t> m_flushSockets;       //本轮末尾要回调HandleFlush的连接
+    std::vector<uint64_t> m_flushingSockets;    //正在回调HandleFlush的连接
+
+    ThreadMutex m_inboxMutex;
+    std::vector<std::function<void()> > m_inbox;        //其他线程投递的任务
+    std::vector<std::function<void()> > m_runningTasks; //本轮要执行的任务
+    std::atomic<bool> m_wakeupPending;  //已经发过唤醒通知还没处理，避免重复写唤醒描述符
+    std::atomic<uint64_t> m_wakeupTimeUs;   //发唤醒通知的时间，用来统计唤醒延迟
+    int m_wakeupFd[2];                  //唤醒描述符，linux下是eventfd(两个相同)，其他系统是pipe
+    bool m_wakeupRegistered;
+
+    ContainerStats m_stats;
+    SocketBudget m_budget;              //连接每轮的公平预算
+    uint32_t m_busyPollUs;              //忙轮询时间(微秒)，0表示不忙轮询
+    uint32_t m_socketBusyPollUs;        //连接的SO_BUSY_POLL时间(微秒)
+    uint64_t m_loopCount;               //事件循环轮数
+    std::vector<SocketBase*> m_socketPool[2];   //按SocketType分开的回收池
+    size_t m_socketPoolSize;            //回收池里每种连接对象最多保留的个数
 
     char m_maxReadBuffer[MAX_READ_BUFF_SIZE];
 };
@@ -0,0 +1,130 @@
+#include "epoll_container_group.h"
+
+using namespace deps;
+
+void EpollContainerGroup::LoopThread::run(){
+    LOG_INFO("container:%p loop start", m_container);
+    while(!m_stop){
+        m_container->HandleSockets();
+    }
+    LOG_INFO("container:%p loop stop", m_container);
+}
+
+EpollContainerGroup::EpollContainerGroup(int loopCount, int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered, bool useIoUring)
+    :m_next(0), m_started(false){
+    if(loopCount <= 0){
+        loopCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(loopCount <= 0){
+            loopCount = 1;
+        }
+    }
+    for(int i = 0; i < loopCount; ++i){
+        EpollContainer* container = useIoUring ? IoUringContainer::Create(maxFdCount, maxFdEventWaitTime, edgeTriggered)
+            : new EpollContainer(maxFdCount, maxFdEventWaitTime, edgeTriggered);
+        m_containers.push_back(container);
+        m_threads.push_back(new LoopThread(container));
+    }
+}
+
+EpollContainerGroup::~EpollContainerGroup(){
+    Stop();
+    for(size_t i = 0; i < m_threads.size(); ++i){
+        delete m_threads[i];
+    }
+    m_threads.clear();
+    for(size_t i = 0; i < m_containers.size(); ++i){
+        delete m_containers[i];
+    }
+    m_containers.clear();
+}
+
+bool EpollContainerGroup::Listen(int port, int backlog, PacketHandler* handler){
+    if(m_started){
+        LOG_ERROR("container group already started, can't listen port:%d", port);
+        return false;
+    }
+    for(size_t i = 0; i < m_containers.size(); ++i){
+        if(!TcpSocket::Listen(port, backlog, m_containers[i], handler, true)){
+            LOG_ERROR("container:%p listen port:%d failed", m_containers[i], port);
+            return false;
+        }
+    }
+    LOG_INFO("container group listen port:%d on %zu loops", port, m_containers.size());
+    return true;
+}
+
+bool EpollContainerGroup::ListenShared(int port, int backlog, PacketHandler* handler){
+    if(m_started){
+        LOG_ERROR("container group already started, can't listen port:%d", port);
+        return false;
+    }
+    int fd = TcpSocket::CreateListenFd(port, backlog, false);
+    if(fd == -1){
+        LOG_ERROR("container group listen port:%d failed", port);
+        return false;
+    }
+    for(size_t i = 0; i < m_containers.size(); ++i){
+        //每个容器持有自己的描述符，关闭时互不影响
+        int dfd = (i + 1 == m_containers.size()) ? fd : dup(fd);
+        if(dfd == -1){
+            LOG_ERROR("container:%p dup listen fd:%d failed %s", m_containers[i], fd, strerror(errno));
+            close(fd);
+            return false;
+        }
+        if(!TcpSocket::ListenFd(dfd, port, m_containers[i], handler, true)){
+            LOG_ERROR("container:%p listen port:%d failed", m_containers[i], port);
+            if(dfd != fd){
+                close(fd);
+            }
+            return false;
+        }
+    }
+    LOG_INFO("container group listen port:%d shared by %zu loops", port, m_containers.size());
+    return true;
+}
+
+void EpollContainerGroup::EnableBusyPoll(uint32_t spinUs, uint32_t socketBusyPollUs){
+    for(size_t i = 0; i < m_containers.size(); ++i){
+        m_containers[i]->EnableBusyPoll(spinUs, socketBusyPollUs);
+    }
+}
+
+bool EpollContainerGroup::Start(){
+    if(m_started){
+        return true;
+    }
+    m_started = true;
+    for(size_t i = 0; i < m_threads.size(); ++i){
+        m_threads[i]->start();
+    }
+    return true;
+}
+
+void EpollContainerGroup::Stop(){
+    if(!m_started){
+        return;
+    }
+    m_started = false;
+    for(size_t i = 0; i < m_threads.size(); ++i){
+        m_threads[i]->Stop();
+    }
+    for(size_t i = 0; i < m_threads.size(); ++i){
+        m_threads[i]->join();
+    }
+}
+
+int EpollContainerGroup::LoopCount(){
+    return (int)m_containers.size();
+}
+
+EpollContainer* EpollContainerGroup::GetContainer(int index){
+    if(index < 0 || index >= (int)m_containers.size()){
+        return nullptr;
+    }
+    return m_containers[index];
+}
+
+EpollContainer* EpollContainerGroup::NextContainer(){
+    uint32_t index = m_next.fetch_add(1);
+    return m_containers[index % m_containers.size()];
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include "../sys/thread.h"
+#include "../sys/log.h"
+#include "epoll_container.h"
+#include "io_uring_container.h"
+#include "tcp_socket.h"
+
+namespace deps{
+/**
+ * @brief 多reactor容器组：每个EpollContainer运行在独立线程上，
+ * 监听端口通过SO_REUSEPORT在每个容器上各打开一次，由内核把新连接分散到各个容器，
+ * 连接在哪个容器accept就一直留在哪个容器处理。
+ * 注意：同一个PacketHandler会被所有容器线程调用，需要自己保证线程安全。
+ */
+class EpollContainerGroup{
+public:
+    /**
+     * @param loopCount 容器(线程)个数，小于等于0时取cpu核数
+     * @param maxFdCount 每个容器最大描述符个数
+     * @param maxFdEventWaitTime 每个容器最长等待事件发生时间(单位是毫秒)
+     * @param edgeTriggered 每个容器是否使用边缘触发模式
+     * @param useIoUring 是否使用io_uring后端，内核不支持时退回epoll。io_uring后端总是边缘触发，
+     * 这时edgeTriggered只对退回的epoll有效
+     */
+    EpollContainerGroup(int loopCount, int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered = false, bool useIoUring = false);
+    ~EpollContainerGroup();
+    EpollContainerGroup(const EpollContainerGroup&)=delete;
+    EpollContainerGroup& operator=(const EpollContainerGroup&)=delete;
+
+    //在每个容器上以SO_REUSEPORT方式监听同一个端口，需要在Start之前调用
+    bool Listen(int port, int backlog, PacketHandler* handler);
+    //所有容器共享同一个监听描述符(每个容器一个dup)，以EPOLLEXCLUSIVE注册，新连接到来时只唤醒一个容器，需要在Start之前调用
+    bool ListenShared(int port, int backlog, PacketHandler* handler);
+    //所有容器打开忙轮询模式，见EpollContainer::EnableBusyPoll，需要在Start之前调用
+    void EnableBusyPoll(uint32_t spinUs, uint32_t socketBusyPollUs = BUSY_POLL_SOCKET_US);
+    //启动所有容器线程
+    bool Start();
+    //停止所有容器线程，最多等待maxFdEventWaitTime毫秒
+    void Stop();
+
+    int LoopCount();
+    EpollContainer* GetContainer(int index);
+    //轮询选择一个容器，用于主动发起连接
+    EpollContainer* NextContainer();
+private:
+    class LoopThread : public Thread{
+    public:
+        LoopThread(EpollContainer* container):m_container(container), m_stop(false){}
+        void Stop(){m_stop = true;}
+    protected:
+        virtual void run();
+    private:
+        EpollContainer* m_container;
+        std::atomic<bool> m_stop;
+    };
+private:
+    std::vector<EpollContainer*> m_containers;
+    std::vector<LoopThread*> m_threads;
+    std::atomic<uint32_t> m_next;
+    bool m_started;
+};
+}
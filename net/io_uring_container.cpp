@@ -0,0 +1,694 @@
+#include <algorithm>
+#include "io_uring_container.h"
+
+#ifdef IO_URING_CONTAINER_ENABLED
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <linux/time_types.h>
+#endif
+
+using namespace deps;
+
+#ifndef IO_URING_CONTAINER_ENABLED
+
+EpollContainer* IoUringContainer::Create(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered){
+    return new EpollContainer(maxFdCount, maxFdEventWaitTime, edgeTriggered);
+}
+
+bool IoUringContainer::IsSupported(){
+    return false;
+}
+
+IoUringContainer::IoUringContainer(int maxFdCount, int maxFdEventWaitTime)
+    :EpollContainer(maxFdCount, maxFdEventWaitTime, true){
+}
+
+IoUringContainer::~IoUringContainer(){
+}
+
+bool IoUringContainer::Setup(){
+    return false;
+}
+
+bool IoUringContainer::CtlSocket(int op, int fd, uint64_t key, uint64_t events){
+    return EpollContainer::CtlSocket(op, fd, key, events);
+}
+
+int IoUringContainer::WaitEvents(int waitTime){
+    return EpollContainer::WaitEvents(waitTime);
+}
+
+bool IoUringContainer::HasRecvCompletion(){
+    return false;
+}
+
+bool IoUringContainer::SubmitSend(SocketBase* s, const struct iovec* iov, int iovcnt){
+    return false;
+}
+
+#else
+
+//完成事件的user_data：连接的key加上请求类型。描述符不会超过2^28，key低32位的高4位用来放请求类型，
+//poll请求的类型是0，user_data就是key；删除、取消请求的完成事件直接忽略
+static const int URING_OP_SHIFT = 28;
+static const uint64_t URING_OP_MASK = 0xFULL << URING_OP_SHIFT;
+enum { URING_POLL = 0, URING_POLL_UPDATE = 1, URING_RECV = 2, URING_ACCEPT = 3, URING_SEND = 4 };
+static const uint64_t URING_IGNORE_DATA = ~0ULL;
+static const uint16_t URING_BUFFER_GROUP = 0;
+
+static uint64_t MakeData(uint64_t key, uint64_t op){
+    return key | (op << URING_OP_SHIFT);
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize){
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nrArgs){
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+//byCompletion为true表示可读由recv/accept请求处理，poll不再关注
+static uint32_t ToPollEvents(uint64_t events, bool byCompletion){
+    uint32_t pollEvents = 0;
+    if(SOCKET_EVENT_READ == (events & SOCKET_EVENT_READ) && !byCompletion){
+        //对端关闭写方向时也通知读，读到0字节关闭连接
+        pollEvents |= POLLIN | POLLRDHUP;
+    }
+    if(SOCKET_EVENT_WRITE == (events & SOCKET_EVENT_WRITE)){
+        pollEvents |= POLLOUT;
+    }
+    if(SOCKET_EVENT_ERROR == (events & SOCKET_EVENT_ERROR)){
+        pollEvents |= POLLERR;
+    }
+    return pollEvents;
+}
+
+EpollContainer* IoUringContainer::Create(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered){
+    IoUringContainer* container = new IoUringContainer(maxFdCount, maxFdEventWaitTime);
+    if(container->Setup()){
+        LOG_INFO("container:%p use io_uring %s", container, container->m_completion ? "completion" : "poll");
+        return container;
+    }
+    delete container;
+    LOG_INFO("io_uring not supported, fall back to epoll");
+    return new EpollContainer(maxFdCount, maxFdEventWaitTime, edgeTriggered);
+}
+
+bool IoUringContainer::IsSupported(){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = io_uring_setup(4, &params);
+    if(fd < 0){
+        return false;
+    }
+    close(fd);
+    //IORING_FEAT_EXT_ARG：5.11支持等待超时；IORING_FEAT_RSRC_TAGS：5.13，和multishot poll同一个版本
+    return (params.features & IORING_FEAT_EXT_ARG) && (params.features & IORING_FEAT_RSRC_TAGS);
+}
+
+IoUringContainer::IoUringContainer(int maxFdCount, int maxFdEventWaitTime)
+    :EpollContainer(maxFdCount, maxFdEventWaitTime, true, true){
+    m_ringFd = -1;
+    m_sqEntries = 0;
+    m_sqRing = MAP_FAILED;
+    m_sqRingSize = 0;
+    m_cqRing = MAP_FAILED;
+    m_cqRingSize = 0;
+    m_sqes = (struct io_uring_sqe*)MAP_FAILED;
+    m_sqesSize = 0;
+    m_sqHead = m_sqTail = m_sqMask = m_sqArray = nullptr;
+    m_cqHead = m_cqTail = m_cqMask = nullptr;
+    m_cqes = nullptr;
+    m_sqLocalTail = 0;
+    m_completion = false;
+    m_bufRing = (struct io_uring_buf_ring*)MAP_FAILED;
+    m_recvBuffers = nullptr;
+    m_bufTail = 0;
+}
+
+IoUringContainer::~IoUringContainer(){
+    if(m_sqes != MAP_FAILED){
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_cqRing != MAP_FAILED && m_cqRing != m_sqRing){
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if(m_sqRing != MAP_FAILED){
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if(m_ringFd != -1){
+        close(m_ringFd);
+    }
+    //关闭io_uring之后内核不再使用接收缓冲区
+    if(m_bufRing != MAP_FAILED){
+        munmap(m_bufRing, URING_RECV_BUFFER_COUNT * sizeof(struct io_uring_buf));
+    }
+    free(m_recvBuffers);
+    for(size_t i = 0; i < m_slots.size(); ++i){
+        delete m_slots[i].m_send;
+    }
+}
+
+bool IoUringContainer::Setup(){
+    if(!IsSupported()){
+        return false;
+    }
+    unsigned entries = URING_SQ_ENTRIES;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    //完成队列要容纳每个描述符的multishot通知
+    //超过内核上限时截断，不然io_uring_setup直接失败
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = m_maxFdCount > (int)entries ? (unsigned)m_maxFdCount * 2 : entries * 2;
+    m_ringFd = io_uring_setup(entries, &params);
+    if(m_ringFd < 0){
+        LOG_ERROR("io_uring_setup failed %s", strerror(errno));
+        m_ringFd = -1;
+        return false;
+    }
+    m_sqEntries = params.sq_entries;
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if(singleMmap){
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if(m_sqRing == MAP_FAILED){
+        LOG_ERROR("io_uring mmap sq ring failed %s", strerror(errno));
+        return false;
+    }
+    if(singleMmap){
+        m_cqRing = m_sqRing;
+    }
+    else{
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        if(m_cqRing == MAP_FAILED){
+            LOG_ERROR("io_uring mmap cq ring failed %s", strerror(errno));
+            return false;
+        }
+    }
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe*)mmap(NULL, m_sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED){
+        LOG_ERROR("io_uring mmap sqes failed %s", strerror(errno));
+        return false;
+    }
+
+    char* sq = (char*)m_sqRing;
+    m_sqHead = (unsigned*)(sq + params.sq_off.head);
+    m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+    m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    m_sqArray = (unsigned*)(sq + params.sq_off.array);
+    char* cq = (char*)m_cqRing;
+    m_cqHead = (unsigned*)(cq + params.cq_off.head);
+    m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+    m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    m_sqLocalTail = *m_sqTail;
+    //完成式收发不可用时仍然可以用multishot poll
+    m_completion = SetupCompletion();
+    return true;
+}
+
+bool IoUringContainer::SetupCompletion(){
+    //IORING_OP_SEND_ZC是6.0加入的，multishot recv、接收缓冲区环和同步取消都是同一个版本
+    std::vector<char> probeBuf(sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe* probe = (struct io_uring_probe*)&probeBuf[0];
+    if(io_uring_register(m_ringFd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0
+        || probe->last_op < IORING_OP_SEND_ZC || !(probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED)){
+        return false;
+    }
+    void* ring = mmap(NULL, URING_RECV_BUFFER_COUNT * sizeof(struct io_uring_buf), PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+    if(ring == MAP_FAILED){
+        LOG_ERROR("io_uring mmap buffer ring failed %s", strerror(errno));
+        return false;
+    }
+    m_bufRing = (struct io_uring_buf_ring*)ring;
+    m_recvBuffers = (char*)malloc((size_t)URING_RECV_BUFFER_COUNT * URING_RECV_BUFFER_SIZE);
+    if(nullptr == m_recvBuffers){
+        LOG_ERROR("io_uring alloc recv buffers failed");
+        return false;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = URING_RECV_BUFFER_COUNT;
+    reg.bgid = URING_BUFFER_GROUP;
+    if(io_uring_register(m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+        LOG_ERROR("io_uring register buffer ring failed %s", strerror(errno));
+        return false;
+    }
+    for(int i = 0; i < URING_RECV_BUFFER_COUNT; ++i){
+        m_usedBuffers.push_back((uint16_t)i);
+    }
+    RecycleBuffers();
+    return true;
+}
+
+bool IoUringContainer::HasRecvCompletion(){
+    return m_completion;
+}
+
+void IoUringContainer::RecycleBuffers(){
+    if(m_usedBuffers.empty()){
+        return;
+    }
+    //C++下头文件里的bufs柔性数组不在偏移0(空结构体占1字节)，直接按环的起始地址索引
+    struct io_uring_buf* bufs = (struct io_uring_buf*)m_bufRing;
+    for(size_t i = 0; i < m_usedBuffers.size(); ++i){
+        uint16_t bid = m_usedBuffers[i];
+        struct io_uring_buf* buf = &bufs[(uint16_t)(m_bufTail + i) & (URING_RECV_BUFFER_COUNT - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(m_recvBuffers + (size_t)bid * URING_RECV_BUFFER_SIZE);
+        buf->len = URING_RECV_BUFFER_SIZE;
+        buf->bid = bid;
+    }
+    m_bufTail += m_usedBuffers.size();
+    __atomic_store_n(&m_bufRing->tail, m_bufTail, __ATOMIC_RELEASE);
+    m_usedBuffers.clear();
+}
+
+int IoUringContainer::Enter(bool wait, int waitTime){
+    unsigned toSubmit = m_sqLocalTail - *m_sqTail;
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    if(!wait && 0 == toSubmit){
+        return 0;
+    }
+
+    unsigned flags = 0;
+    unsigned minComplete = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void* argp = NULL;
+    size_t argSize = 0;
+    if(wait){
+        flags = IORING_ENTER_GETEVENTS;
+        minComplete = 1;
+        if(waitTime >= 0){
+            ts.tv_sec = waitTime / 1000;
+            ts.tv_nsec = (long long)(waitTime % 1000) * 1000000;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            argp = &arg;
+            argSize = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+    GetStats().m_uringEnterCalls.fetch_add(1, std::memory_order_relaxed);
+    int ret = io_uring_enter(m_ringFd, toSubmit, minComplete, flags, argp, argSize);
+    if(ret < 0 && errno != ETIME && errno != EINTR){
+        LOG_ERROR("io_uring_enter failed %s", strerror(errno));
+    }
+    return ret;
+}
+
+struct io_uring_sqe* IoUringContainer::GetSqe(){
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_sqLocalTail - head >= m_sqEntries){
+        //提交队列满了先提交
+        Enter(false, 0);
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if(m_sqLocalTail - head >= m_sqEntries){
+            return nullptr;
+        }
+    }
+    unsigned index = m_sqLocalTail & *m_sqMask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    ++m_sqLocalTail;
+    return sqe;
+}
+
+bool IoUringContainer::PrepPollAdd(int fd, uint64_t key, uint32_t pollEvents){
+    struct io_uring_sqe* sqe = GetSqe();
+    if(nullptr == sqe){
+        LOG_ERROR("fd:%d io_uring submission queue full", fd);
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = pollEvents;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = MakeData(key, URING_POLL);
+    return true;
+}
+
+bool IoUringContainer::PrepRecv(int fd, uint64_t key){
+    struct io_uring_sqe* sqe = GetSqe();
+    if(nullptr == sqe){
+        LOG_ERROR("fd:%d io_uring submission queue full", fd);
+        return false;
+    }
+    //每次有数据时从接收缓冲区环里取一个缓冲区
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = MakeData(key, URING_RECV);
+    return true;
+}
+
+bool IoUringContainer::PrepAccept(int fd, uint64_t key){
+    struct io_uring_sqe* sqe = GetSqe();
+    if(nullptr == sqe){
+        LOG_ERROR("fd:%d io_uring submission queue full", fd);
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = MakeData(key, URING_ACCEPT);
+    return true;
+}
+
+bool IoUringContainer::PrepCancel(uint64_t data){
+    struct io_uring_sqe* sqe = GetSqe();
+    if(nullptr == sqe){
+        LOG_ERROR("fd:%d io_uring submission queue full", KeyFd(data & ~URING_OP_MASK));
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = URING_IGNORE_DATA;
+    return true;
+}
+
+void IoUringContainer::Rearm(uint64_t data){
+    uint64_t key = data & ~URING_OP_MASK;
+    int fd = KeyFd(key);
+    UringSlot& slot = m_slots[fd];
+    bool ok = false;
+    switch((data & URING_OP_MASK) >> URING_OP_SHIFT){
+    case URING_RECV:
+        ok = PrepRecv(fd, key);
+        if(ok){
+            ++slot.m_recvCount;
+        }
+        break;
+    case URING_ACCEPT:
+        ok = PrepAccept(fd, key);
+        if(ok){
+            ++slot.m_acceptCount;
+        }
+        break;
+    default:
+        ok = PrepPollAdd(fd, key, slot.m_pollEvents);
+        break;
+    }
+    if(!ok){
+        m_rearms.push_back(data);
+    }
+}
+
+bool IoUringContainer::NeedRearm(uint64_t data){
+    uint64_t key = data & ~URING_OP_MASK;
+    int fd = KeyFd(key);
+    if((size_t)fd >= m_slots.size() || m_slots[fd].m_generation != KeyGeneration(key)){
+        return false;
+    }
+    if(nullptr == GetSocket(key) && key != m_wakeupKey){
+        return false;
+    }
+    const UringSlot& slot = m_slots[fd];
+    switch((data & URING_OP_MASK) >> URING_OP_SHIFT){
+    case URING_RECV:
+        return slot.m_recv && 0 == slot.m_recvCount;
+    case URING_ACCEPT:
+        return slot.m_accept && 0 == slot.m_acceptCount;
+    default:
+        return true;
+    }
+}
+
+void IoUringContainer::CancelSend(uint64_t key){
+    //发送请求可能还在提交队列里，先提交再等内核取消或者完成
+    Enter(false, 0);
+    struct io_uring_sync_cancel_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = MakeData(key, URING_SEND);
+    reg.fd = -1;
+    reg.flags = IORING_ASYNC_CANCEL_ALL;
+    reg.timeout.tv_sec = -1;
+    reg.timeout.tv_nsec = -1;
+    //已经完成时返回ENOENT
+    if(io_uring_register(m_ringFd, IORING_REGISTER_SYNC_CANCEL, &reg, 1) < 0 && errno != ENOENT){
+        LOG_ERROR("fd:%d io_uring cancel send failed %s", KeyFd(key), strerror(errno));
+    }
+}
+
+bool IoUringContainer::CtlSocket(int op, int fd, uint64_t key, uint64_t events){
+    if((size_t)fd >= m_slots.size()){
+        m_slots.resize(std::max((size_t)fd + 1, m_slots.size() * 2));
+    }
+    UringSlot& slot = m_slots[fd];
+    if(CTL_DEL == op){
+        struct io_uring_sqe* sqe = GetSqe();
+        if(nullptr == sqe){
+            LOG_ERROR("fd:%d io_uring submission queue full", fd);
+            errno = EBUSY;
+            return false;
+        }
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = MakeData(key, URING_POLL);
+        sqe->user_data = URING_IGNORE_DATA;
+        //multishot recv/accept在取消之前一直引用着描述符
+        if(slot.m_recv || slot.m_recvCount > 0){
+            PrepCancel(MakeData(key, URING_RECV));
+        }
+        if(slot.m_accept || slot.m_acceptCount > 0){
+            PrepCancel(MakeData(key, URING_ACCEPT));
+        }
+        //关闭连接时会清空发送队列，要等内核放开正在发送的数据
+        if(slot.m_sendInFlight){
+            CancelSend(key);
+        }
+        slot.m_pollEvents = 0;
+        slot.m_recv = false;
+        slot.m_accept = false;
+        slot.m_sendInFlight = false;
+        return true;
+    }
+
+    bool recv = m_completion && (SOCKET_EVENT_READ | SOCKET_EVENT_RECV) == (events & (SOCKET_EVENT_READ | SOCKET_EVENT_RECV));
+    bool accept = m_completion && (SOCKET_EVENT_READ | SOCKET_EVENT_ACCEPT) == (events & (SOCKET_EVENT_READ | SOCKET_EVENT_ACCEPT));
+    uint32_t pollEvents = ToPollEvents(events, recv || accept);
+    if(CTL_ADD == op){
+        SendRequest* send = slot.m_send;
+        slot = UringSlot();
+        slot.m_send = send;
+        slot.m_generation = KeyGeneration(key);
+        slot.m_pollEvents = pollEvents;
+        if(!PrepPollAdd(fd, key, pollEvents)){
+            slot.m_pollEvents = 0;
+            errno = EBUSY;
+            return false;
+        }
+        slot.m_recv = recv;
+        slot.m_accept = accept;
+        if(recv){
+            Rearm(MakeData(key, URING_RECV));
+        }
+        if(accept){
+            Rearm(MakeData(key, URING_ACCEPT));
+        }
+        return true;
+    }
+
+    if(pollEvents != slot.m_pollEvents){
+        struct io_uring_sqe* sqe = GetSqe();
+        if(nullptr == sqe){
+            LOG_ERROR("fd:%d io_uring submission queue full", fd);
+            errno = EBUSY;
+            return false;
+        }
+        //原地修改multishot poll关注的事件
+        slot.m_pollEvents = pollEvents;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = MakeData(key, URING_POLL);
+        sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = pollEvents;
+        sqe->user_data = MakeData(key, URING_POLL_UPDATE);
+    }
+    //暂停读取时取消recv，恢复时重新开始；取消请求在新请求之前提交，只取消旧的
+    if(recv && !slot.m_recv){
+        slot.m_recv = true;
+        Rearm(MakeData(key, URING_RECV));
+    }
+    else if(!recv && slot.m_recv){
+        //立即提交，减少取消之前继续送达的数据
+        slot.m_recv = false;
+        PrepCancel(MakeData(key, URING_RECV));
+        Enter(false, 0);
+    }
+    return true;
+}
+
+bool IoUringContainer::SubmitSend(SocketBase* s, const struct iovec* iov, int iovcnt){
+    uint64_t key = s->GetId();
+    if(!m_completion || iovcnt <= 0 || GetSocket(key) != s){
+        return false;
+    }
+    UringSlot& slot = m_slots[s->GetFd()];
+    if(slot.m_sendInFlight){
+        return false;
+    }
+    struct io_uring_sqe* sqe = GetSqe();
+    if(nullptr == sqe){
+        LOG_ERROR("fd:%d io_uring submission queue full", s->GetFd());
+        return false;
+    }
+    if(nullptr == slot.m_send){
+        slot.m_send = new SendRequest;
+    }
+    SendRequest* req = slot.m_send;
+    int n = std::min(iovcnt, URING_SEND_IOV_MAX);
+    memcpy(req->m_iov, iov, n * sizeof(struct iovec));
+    memset(&req->m_msg, 0, sizeof(req->m_msg));
+    req->m_msg.msg_iov = req->m_iov;
+    req->m_msg.msg_iovlen = n;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = s->GetFd();
+    sqe->addr = (uint64_t)(uintptr_t)&req->m_msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = MakeData(key, URING_SEND);
+    slot.m_sendInFlight = true;
+    return true;
+}
+
+int IoUringContainer::WaitEvents(int waitTime){
+    //上一轮送达的数据已经处理完，缓冲区还给内核
+    RecycleBuffers();
+    //上一轮提交队列满了没能重新注册的请求，连接还在就再试一次
+    if(!m_rearms.empty()){
+        std::vector<uint64_t> rearms;
+        rearms.swap(m_rearms);
+        for(size_t i = 0; i < rearms.size(); ++i){
+            if(NeedRearm(rearms[i])){
+                Rearm(rearms[i]);
+            }
+        }
+    }
+    //完成队列里还有没处理的事件就只提交不等待
+    unsigned head = *m_cqHead;
+    bool wait = (0 != waitTime && head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE));
+    Enter(wait, waitTime);
+
+    int ready = 0;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    while(head != tail && ready < (int)m_readyEvents.size()){
+        struct io_uring_cqe* cqe = &m_cqes[head & *m_cqMask];
+        uint64_t data = cqe->user_data;
+        int res = cqe->res;
+        uint32_t flags = cqe->flags;
+        ++head;
+
+        if(URING_IGNORE_DATA == data){
+            continue;
+        }
+        uint64_t key = data & ~URING_OP_MASK;
+        int fd = KeyFd(key);
+        bool more = (flags & IORING_CQE_F_MORE);
+        //描述符已经被新连接复用时，之前连接的请求结束不改变请求状态
+        UringSlot* slot = ((size_t)fd < m_slots.size() && m_slots[fd].m_generation == KeyGeneration(key)) ? &m_slots[fd] : nullptr;
+        ReadyEvent& ev = m_readyEvents[ready];
+        ev.m_key = key;
+        ev.m_events = 0;
+        ev.m_data = nullptr;
+        ev.m_result = res;
+        switch((data & URING_OP_MASK) >> URING_OP_SHIFT){
+        case URING_POLL_UPDATE:
+            //multishot已经结束，修改找不到原请求，重新注册
+            if(-ENOENT == res && NeedRearm(MakeData(key, URING_POLL))){
+                Rearm(MakeData(key, URING_POLL));
+            }
+            break;
+        case URING_POLL:
+            if(res < 0){
+                if(-ECANCELED != res){
+                    LOG_ERROR("fd:%d io_uring poll failed %s", fd, strerror(-res));
+                }
+            }
+            else{
+                if(res & POLLERR){
+                    ev.m_events |= SOCKET_EVENT_ERROR;
+                }
+                //由recv/accept接收时对端关闭也通过recv送达
+                if((res & (POLLIN | POLLHUP | POLLRDHUP)) && !(slot && (slot->m_recv || slot->m_accept))){
+                    ev.m_events |= SOCKET_EVENT_READ;
+                }
+                if(res & POLLOUT){
+                    ev.m_events |= SOCKET_EVENT_WRITE;
+                }
+            }
+            //multishot被内核结束(例如完成队列溢出)，连接还在就重新注册
+            if(!more && -ECANCELED != res && NeedRearm(data)){
+                Rearm(data);
+            }
+            break;
+        case URING_RECV:
+            if(flags & IORING_CQE_F_BUFFER){
+                uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+                m_usedBuffers.push_back(bid);
+                ev.m_data = m_recvBuffers + (size_t)bid * URING_RECV_BUFFER_SIZE;
+            }
+            if(!more && slot && slot->m_recvCount > 0){
+                --slot->m_recvCount;
+            }
+            //缓冲区暂时用完时不通知连接，下一轮还回缓冲区后重新接收
+            if(-ENOBUFS != res && -ECANCELED != res){
+                ev.m_events = SOCKET_EVENT_RECV;
+            }
+            if(!more && (res > 0 || -ENOBUFS == res) && NeedRearm(data)){
+                Rearm(data);
+            }
+            break;
+        case URING_ACCEPT:
+            if(!more && slot && slot->m_acceptCount > 0){
+                --slot->m_acceptCount;
+            }
+            if(res >= 0){
+                ev.m_events = SOCKET_EVENT_ACCEPT;
+            }
+            else if(-ECANCELED != res){
+                //出错时(例如描述符用完)交给监听连接自己accept处理
+                LOG_ERROR("fd:%d io_uring accept failed %s", fd, strerror(-res));
+                ev.m_events = SOCKET_EVENT_READ;
+            }
+            if(!more && -ECANCELED != res && NeedRearm(data)){
+                Rearm(data);
+            }
+            break;
+        case URING_SEND:
+            if(slot && slot->m_sendInFlight){
+                slot->m_sendInFlight = false;
+                ev.m_events = SOCKET_EVENT_SEND_DONE;
+            }
+            break;
+        default:
+            break;
+        }
+        if(0 != ev.m_events){
+            ++ready;
+        }
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return ready;
+}
+
+#endif
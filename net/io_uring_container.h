@@ -0,0 +1,115 @@
+#pragma once
+
+#include "epoll_container.h"
+
+#if !defined(__APPLE__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+//multishot poll和IORING_FEAT_RSRC_TAGS是5.13的内核头文件才有的，multishot recv/accept和接收缓冲区环要6.0的头文件，
+//更早的头文件编译成退回epoll的空实现
+#if defined(IORING_POLL_ADD_MULTI) && defined(IORING_FEAT_RSRC_TAGS) && defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define IO_URING_CONTAINER_ENABLED
+#endif
+
+#define URING_SQ_ENTRIES        4096        //提交队列长度，每轮的请求一起提交，满了会提前提交
+//接收缓冲区环：单个连接暂停读取后最多还会送达整个环的数据，总大小要小于TcpSocket接收缓冲区的上限(4M)才能全部存下
+#define URING_RECV_BUFFER_SIZE  4096        //每个缓冲区的大小
+#define URING_RECV_BUFFER_COUNT 512         //缓冲区个数，必须是2的幂
+#define URING_SEND_IOV_MAX      64          //每次提交发送最多的数据段，剩下的完成后接着发
+
+namespace deps{
+/**
+ * @brief 基于io_uring的容器，内核6.0以上是完成式收发：
+ * 监听描述符用multishot accept，新连接的描述符随完成事件送达(HandleAccept)；
+ * TCP连接用multishot recv从注册的接收缓冲区环里取缓冲区，数据随完成事件送达(HandleRecv)，本轮处理完再把缓冲区还给内核；
+ * 发送由TcpSocket在本轮末尾交给容器(SubmitSend)，用IORING_OP_SENDMSG发出。
+ * 所有的请求和等待合并成每轮一次io_uring_enter，活跃连接不再有各自的读写系统调用。
+ * 错误、可写通知、UDP、唤醒描述符和还在连接中的连接用multishot poll。
+ * 5.13到5.19的内核只支持multishot poll，只替换epoll_ctl/epoll_wait，读写仍由连接自己调用。
+ * multishot只在状态变化时通知，所以固定使用边缘触发模式。
+ * 需要5.13以上内核，不支持时Create会退回EpollContainer。
+ */
+class IoUringContainer : public EpollContainer{
+public:
+    //io_uring可用时返回IoUringContainer(总是边缘触发)，否则返回EpollContainer，edgeTriggered只对退回的epoll有效
+    static EpollContainer* Create(int maxFdCount, int maxFdEventWaitTime, bool edgeTriggered = false);
+    //当前内核是否支持
+    static bool IsSupported();
+
+    virtual ~IoUringContainer();
+    virtual bool HasRecvCompletion();
+    virtual bool SubmitSend(SocketBase* s, const struct iovec* iov, int iovcnt);
+protected:
+    IoUringContainer(int maxFdCount, int maxFdEventWaitTime);
+    bool Setup();
+    virtual bool CtlSocket(int op, int fd, uint64_t key, uint64_t events);
+    virtual int WaitEvents(int waitTime);
+#ifdef IO_URING_CONTAINER_ENABLED
+private:
+    //交给内核的发送参数，发送完成前要保持有效
+    struct SendRequest{
+        struct msghdr m_msg;
+        struct iovec m_iov[URING_SEND_IOV_MAX];
+    };
+    //按描述符索引的请求状态
+    struct UringSlot{
+        UringSlot():m_generation(0), m_pollEvents(0), m_recvCount(0), m_acceptCount(0),
+            m_recv(false), m_accept(false), m_sendInFlight(false), m_send(nullptr){}
+        uint32_t m_generation;      //当前连接的generation，之前连接的完成事件不改变请求状态
+        uint32_t m_pollEvents;      //multishot poll关注的事件，multishot结束时用来重新注册
+        uint16_t m_recvCount;       //内核里还没结束的recv请求数
+        uint16_t m_acceptCount;     //内核里还没结束的accept请求数
+        bool m_recv;                //是否由后端接收数据
+        bool m_accept;              //是否由后端接收新连接
+        bool m_sendInFlight;        //是否有没完成的发送
+        SendRequest* m_send;        //第一次发送时分配，描述符复用时继续使用
+    };
+    //6.0以上内核注册接收缓冲区环，成功后使用完成式收发
+    bool SetupCompletion();
+    struct io_uring_sqe* GetSqe();
+    //以下几个在提交队列满了时返回false
+    bool PrepPollAdd(int fd, uint64_t key, uint32_t pollEvents);
+    bool PrepRecv(int fd, uint64_t key);
+    bool PrepAccept(int fd, uint64_t key);
+    bool PrepCancel(uint64_t data);
+    //按user_data重新注册multishot请求，提交队列满了留到下一轮再试
+    void Rearm(uint64_t data);
+    //请求对应的连接还在、还需要这个请求并且内核里没有同类请求时返回true
+    bool NeedRearm(uint64_t data);
+    //同步取消没完成的发送，返回后内核不再访问发送队列的内存
+    void CancelSend(uint64_t key);
+    //把上一轮送达的接收缓冲区还给内核
+    void RecycleBuffers();
+    //提交请求；wait为true时等待至少一个完成事件，最多等waitTime毫秒，waitTime小于0表示一直等
+    int Enter(bool wait, int waitTime);
+private:
+    int m_ringFd;
+    unsigned m_sqEntries;
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    struct io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqMask;
+    unsigned* m_sqArray;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned* m_cqMask;
+    struct io_uring_cqe* m_cqes;
+    unsigned m_sqLocalTail;             //已经填好还没有提交的请求尾部
+    bool m_completion;                  //是否使用完成式收发
+    struct io_uring_buf_ring* m_bufRing;//注册给内核的接收缓冲区环
+    char* m_recvBuffers;                //URING_RECV_BUFFER_COUNT个接收缓冲区
+    uint16_t m_bufTail;
+    std::vector<uint16_t> m_usedBuffers;//本轮送达的接收缓冲区，下一轮等待前还给内核
+    std::vector<UringSlot> m_slots;
+    std::vector<uint64_t> m_rearms;     //提交队列满了没能重新注册的请求
+#endif
+};
+}
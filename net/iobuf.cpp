@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <atomic>
+#include <algorithm>
+#include "iobuf.h"
+#include "buffer_memory.h"
+
+using namespace deps;
+
+namespace{
+int IOBufTypeId(){
+    static int id = BufferMemory::RegisterType("IOBuf");
+    return id;
+}
+}
+
+struct IOBuf::Block{
+    std::atomic<int> m_refs;
+    char* m_data;                       //自己分配的块紧跟在Block后面，外部内存是使用者的指针
+    size_t m_capacity;
+    std::function<void()> m_release;    //外部内存的释放函数，自己分配的块为空
+};
+
+IOBuf::IOBuf(){
+    m_size = 0;
+}
+
+IOBuf::~IOBuf(){
+    Clear();
+}
+
+IOBuf::IOBuf(const IOBuf& other){
+    m_size = 0;
+    Append(other);
+}
+
+IOBuf& IOBuf::operator=(const IOBuf& other){
+    if(this != &other){
+        IOBuf tmp(other);
+        Swap(tmp);
+    }
+    return *this;
+}
+
+IOBuf::IOBuf(IOBuf&& other){
+    m_size = 0;
+    Swap(other);
+}
+
+IOBuf& IOBuf::operator=(IOBuf&& other){
+    if(this != &other){
+        Clear();
+        Swap(other);
+    }
+    return *this;
+}
+
+IOBuf::Block* IOBuf::NewBlock(size_t capacity){
+    void* p = malloc(sizeof(Block) + capacity);
+    if(nullptr == p){
+        return nullptr;
+    }
+    Block* block = new (p) Block();
+    block->m_refs.store(1, std::memory_order_relaxed);
+    block->m_data = (char*)p + sizeof(Block);
+    block->m_capacity = capacity;
+    BufferMemory::Add(IOBufTypeId(), BUFFER_ROLE_OTHER, sizeof(Block) + capacity);
+    return block;
+}
+
+void IOBuf::Ref(Block* block){
+    block->m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IOBuf::Unref(Block* block){
+    if(1 != block->m_refs.fetch_sub(1, std::memory_order_acq_rel)){
+        return;
+    }
+    if(block->m_release){
+        block->m_release();
+    }
+    //外部内存只记了Block本身
+    bool owned = block->m_data == (char*)block + sizeof(Block);
+    BufferMemory::Add(IOBufTypeId(), BUFFER_ROLE_OTHER, -(int64_t)(sizeof(Block) + (owned ? block->m_capacity : 0)));
+    block->~Block();
+    free(block);
+}
+
+bool IOBuf::Writable(const Block* block){
+    return !block->m_release && 1 == block->m_refs.load(std::memory_order_acquire);
+}
+
+char* IOBuf::BlockBegin(const Block* block){
+    return block->m_data;
+}
+
+char* IOBuf::BlockEnd(const Block* block){
+    return block->m_data + block->m_capacity;
+}
+
+bool IOBuf::Append(const char* data, size_t size){
+    if(nullptr == data || size < 1){
+        return true;
+    }
+    //尾部的块还有空间就接着写
+    if(!m_spans.empty()){
+        Span& tail = m_spans.back();
+        char* end = tail.m_data + tail.m_size;
+        if(Writable(tail.m_block) && end < BlockEnd(tail.m_block)){
+            size_t n = std::min(size, (size_t)(BlockEnd(tail.m_block) - end));
+            memcpy(end, data, n);
+            tail.m_size += n;
+            m_size += n;
+            data += n;
+            size -= n;
+            if(0 == size){
+                return true;
+            }
+        }
+    }
+    //空的IOBuf在块前面留出包头的空间
+    size_t headroom = m_spans.empty() ? IOBUF_HEADROOM : 0;
+    Block* block = NewBlock(headroom + std::max(size, (size_t)IOBUF_BLOCK_SIZE - headroom));
+    if(nullptr == block){
+        return false;
+    }
+    Span span;
+    span.m_block = block;
+    span.m_data = block->m_data + headroom;
+    span.m_size = size;
+    memcpy(span.m_data, data, size);
+    m_spans.push_back(span);
+    m_size += size;
+    return true;
+}
+
+void IOBuf::Append(const IOBuf& other){
+    //追加自己时先复制一份
+    if(&other == this){
+        IOBuf copy(other);
+        Append(copy);
+        return;
+    }
+    for(size_t i = 0; i < other.m_spans.size(); ++i){
+        Ref(other.m_spans[i].m_block);
+        m_spans.push_back(other.m_spans[i]);
+        m_size += other.m_spans[i].m_size;
+    }
+}
+
+bool IOBuf::AppendExternal(const char* data, size_t size, const std::function<void()>& release){
+    if(nullptr == data || size < 1){
+        if(release){
+            release();
+        }
+        return true;
+    }
+    Block* block = NewBlock(0);
+    if(nullptr == block){
+        return false;
+    }
+    block->m_data = (char*)data;
+    block->m_capacity = size;
+    block->m_release = release;
+    Span span;
+    span.m_block = block;
+    span.m_data = block->m_data;
+    span.m_size = size;
+    m_spans.push_back(span);
+    m_size += size;
+    return true;
+}
+
+bool IOBuf::Prepend(const char* data, size_t size){
+    if(nullptr == data || size < 1){
+        return true;
+    }
+    //第一片前面的空间没有别人引用，直接写在前面
+    if(!m_spans.empty()){
+        Span& head = m_spans.front();
+        if(Writable(head.m_block) && (size_t)(head.m_data - BlockBegin(head.m_block)) >= size){
+            head.m_data -= size;
+            head.m_size += size;
+            memcpy(head.m_data, data, size);
+            m_size += size;
+            return true;
+        }
+    }
+    //新块的数据放在末尾，后面的前插还可以继续使用这个块
+    Block* block = NewBlock(std::max(size, (size_t)IOBUF_HEADROOM));
+    if(nullptr == block){
+        return false;
+    }
+    Span span;
+    span.m_block = block;
+    span.m_data = BlockEnd(block) - size;
+    span.m_size = size;
+    memcpy(span.m_data, data, size);
+    m_spans.insert(m_spans.begin(), span);
+    m_size += size;
+    return true;
+}
+
+void IOBuf::Consume(size_t n){
+    size_t i = 0;
+    while(n > 0 && i < m_spans.size()){
+        Span& span = m_spans[i];
+        if(n < span.m_size){
+            span.m_data += n;
+            span.m_size -= n;
+            m_size -= n;
+            break;
+        }
+        n -= span.m_size;
+        m_size -= span.m_size;
+        Unref(span.m_block);
+        ++i;
+    }
+    m_spans.erase(m_spans.begin(), m_spans.begin() + i);
+}
+
+void IOBuf::Clear(){
+    for(size_t i = 0; i < m_spans.size(); ++i){
+        Unref(m_spans[i].m_block);
+    }
+    m_spans.clear();
+    m_size = 0;
+}
+
+void IOBuf::Swap(IOBuf& other){
+    m_spans.swap(other.m_spans);
+    std::swap(m_size, other.m_size);
+}
+
+IOBuf IOBuf::Slice(size_t offset, size_t size) const{
+    IOBuf buf;
+    for(size_t i = 0; i < m_spans.size() && size > 0; ++i){
+        const IOBuf::Span& span = m_spans[i];
+        if(offset >= span.m_size){
+            offset -= span.m_size;
+            continue;
+        }
+        IOBuf::Span part = span;
+        part.m_data += offset;
+        part.m_size = std::min(span.m_size - offset, size);
+        offset = 0;
+        Ref(part.m_block);
+        buf.m_spans.push_back(part);
+        buf.m_size += part.m_size;
+        size -= part.m_size;
+    }
+    return buf;
+}
+
+size_t IOBuf::CopyTo(char* dst, size_t size, size_t offset) const{
+    size_t copied = 0;
+    for(size_t i = 0; i < m_spans.size() && copied < size; ++i){
+        const IOBuf::Span& span = m_spans[i];
+        if(offset >= span.m_size){
+            offset -= span.m_size;
+            continue;
+        }
+        size_t n = std::min(span.m_size - offset, size - copied);
+        memcpy(dst + copied, span.m_data + offset, n);
+        copied += n;
+        offset = 0;
+    }
+    return copied;
+}
+
+std::string IOBuf::ToString() const{
+    std::string s;
+    s.reserve(m_size);
+    for(size_t i = 0; i < m_spans.size(); ++i){
+        s.append(m_spans[i].m_data, m_spans[i].m_size);
+    }
+    return s;
+}
+
+int IOBuf::GetIov(struct iovec* iov, int maxIov) const{
+    int n = 0;
+    for(size_t i = 0; i < m_spans.size() && n < maxIov; ++i){
+        iov[n].iov_base = m_spans[i].m_data;
+        iov[n].iov_len = m_spans[i].m_size;
+        ++n;
+    }
+    return n;
+}
+
+void IOBuf::ShareSlices(const std::function<void(const char* data, size_t size, const std::function<void()>& release)>& visit) const{
+    //visit里可能修改this，先复制一份片的列表
+    std::vector<IOBuf::Span> spans(m_spans);
+    for(size_t i = 0; i < spans.size(); ++i){
+        Block* block = spans[i].m_block;
+        Ref(block);
+        visit(spans[i].m_data, spans[i].m_size, [block](){
+            Unref(block);
+        });
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/uio.h>
+
+namespace deps{
+/**
+ * @brief 链式缓冲区：数据由若干片组成，每一片引用一个带引用计数的内存块的一段。
+ * 追加时尾部的块写满了就挂一个新块，不需要像BlockBuffer那样重新分配并拷贝已有数据；
+ * 第一个块前面预留IOBUF_HEADROOM字节，包头可以直接写在数据前面；
+ * 拷贝IOBuf、Slice、Append(const IOBuf&)只增加引用计数，同一份数据可以交给多个连接发送。
+ * 引用计数是原子的，共享的IOBuf可以交给其他线程；同一个IOBuf对象不能在多个线程里同时修改。
+ * 被多个IOBuf共享的块不再写入，追加和前插时另起新块，已经交出去的数据不会被改变。
+ */
+class IOBuf{
+public:
+    enum { IOBUF_BLOCK_SIZE = 8192 };   //新块的默认大小
+    enum { IOBUF_HEADROOM = 64 };       //块前面给包头预留的空间
+
+    IOBuf();
+    ~IOBuf();
+    //共享other的数据，不拷贝
+    IOBuf(const IOBuf& other);
+    IOBuf& operator=(const IOBuf& other);
+    IOBuf(IOBuf&& other);
+    IOBuf& operator=(IOBuf&& other);
+
+    size_t Size() const {return m_size;}
+    bool Empty() const {return 0 == m_size;}
+    size_t SliceCount() const {return m_spans.size();}
+
+    //拷贝数据追加到尾部，内存分配失败返回false，这时数据不变
+    bool Append(const char* data, size_t size);
+    //共享other的数据追加到尾部
+    void Append(const IOBuf& other);
+    //不拷贝，直接引用data，所有引用都释放后调用release
+    bool AppendExternal(const char* data, size_t size, const std::function<void()>& release);
+    //拷贝数据插入到头部，头部有预留空间时不分配内存
+    bool Prepend(const char* data, size_t size);
+    //从头部删除n字节
+    void Consume(size_t n);
+    void Clear();
+    void Swap(IOBuf& other);
+
+    //共享[offset, offset+size)这一段，超出的部分截掉
+    IOBuf Slice(size_t offset, size_t size) const;
+    //从offset开始拷贝最多size字节到dst，返回拷贝的长度
+    size_t CopyTo(char* dst, size_t size, size_t offset = 0) const;
+    std::string ToString() const;
+    //每一片的视图，返回填充的个数
+    int GetIov(struct iovec* iov, int maxIov) const;
+    /**
+     * @brief 依次把每一片交给visit：片的数据、长度和释放函数。每一片额外持有一个引用，
+     * visit负责在不再使用数据时调用release(可以转交出去，比如TcpSocket的发送队列)，IOBuf本身不受影响。
+     */
+    void ShareSlices(const std::function<void(const char* data, size_t size, const std::function<void()>& release)>& visit) const;
+private:
+    struct Block;
+    struct Span{
+        Block* m_block;
+        char* m_data;
+        size_t m_size;
+    };
+    static Block* NewBlock(size_t capacity);
+    static void Ref(Block* block);
+    static void Unref(Block* block);
+    //块只被一个IOBuf引用并且是自己分配的内存，可以继续写入
+    static bool Writable(const Block* block);
+    static char* BlockBegin(const Block* block);
+    static char* BlockEnd(const Block* block);
+private:
+    std::vector<Span> m_spans;
+    size_t m_size;
+};
+}
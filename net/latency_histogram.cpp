@@ -0,0 +1,66 @@
+#include "latency_histogram.h"
+
+using namespace deps;
+
+LatencyHistogram::LatencyHistogram(){
+    Reset();
+}
+
+void LatencyHistogram::Record(uint64_t us){
+    m_buckets[Index(us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    if(us > m_max.load(std::memory_order_relaxed)){
+        m_max.store(us, std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const{
+    uint64_t count = Count();
+    if(0 == count){
+        return 0;
+    }
+    uint64_t target = (uint64_t)(count * p / 100.0 + 0.5);
+    if(target < 1){
+        target = 1;
+    }
+    uint64_t sum = 0;
+    for(size_t i = 0; i < BUCKETS; ++i){
+        sum += m_buckets[i].load(std::memory_order_relaxed);
+        if(sum >= target){
+            uint64_t bound = UpperBound(i);
+            uint64_t max = Max();
+            return bound < max ? bound : max;
+        }
+    }
+    return Max();
+}
+
+void LatencyHistogram::Reset(){
+    for(size_t i = 0; i < BUCKETS; ++i){
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::Index(uint64_t us){
+    if(us < LINEAR_BUCKETS){
+        return us;
+    }
+    if(us >= ((uint64_t)1 << MAX_BITS)){
+        us = ((uint64_t)1 << MAX_BITS) - 1;
+    }
+    int msb = 63 - __builtin_clzll(us);
+    size_t sub = (us >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return LINEAR_BUCKETS + (msb - 5) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::UpperBound(size_t index){
+    if(index < LINEAR_BUCKETS){
+        return index;
+    }
+    int msb = 5 + (index - LINEAR_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+    uint64_t low = (SUB_BUCKETS + sub) << (msb - SUB_BITS);
+    return low + ((uint64_t)1 << (msb - SUB_BITS)) - 1;
+}
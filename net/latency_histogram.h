@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+
+namespace deps{
+/**
+ * @brief 延迟直方图(单位是微秒)：小于32微秒的值每个微秒一个桶，之后每个2的幂区间分成16个桶，
+ * 相对误差不超过1/16，最大记录到2^32微秒，超过的按最大值记录。
+ * 由一个线程记录，其他线程可以随时读取分位数。
+ */
+class LatencyHistogram{
+public:
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&)=delete;
+    LatencyHistogram& operator=(const LatencyHistogram&)=delete;
+
+    void Record(uint64_t us);
+    //p取0到100，返回不小于p%样本的最小桶的上界，没有样本时返回0
+    uint64_t Percentile(double p) const;
+    uint64_t Count() const {return m_count.load(std::memory_order_relaxed);}
+    uint64_t Max() const {return m_max.load(std::memory_order_relaxed);}
+    //清空所有样本，和Record同时调用时可能丢失少量样本
+    void Reset();
+private:
+    enum { LINEAR_BUCKETS = 32, SUB_BITS = 4, SUB_BUCKETS = 1 << SUB_BITS, MAX_BITS = 32 };
+    enum { BUCKETS = LINEAR_BUCKETS + (MAX_BITS - 5) * SUB_BUCKETS };
+    static size_t Index(uint64_t us);
+    static uint64_t UpperBound(size_t index);
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_max;
+};
+}
@@ -7,6 +7,7 @@
 #include <vector>
 #include <set>
 #include "blockbuffer.h"
+#include "iobuf.h"
 #include "varstr.h"
 
 namespace deps{
@@ -40,6 +41,10 @@ private:
 	//set packet max size 64k
 	BlockBuffer<def_block_alloc_4k, 16> bb;
 public:
+	PackBuffer()
+	{
+		bb.set_role(BUFFER_ROLE_PACK);
+	}
 	char * data()
 	{
 		return bb.data();
@@ -181,6 +186,14 @@ public:
 	{
 		m_buffer.append((const char *)s); return *this;
 	}
+	// copy the chained buffer's slices in order
+	Pack & push(const IOBuf & buf)
+	{
+		size_t old = m_buffer.size();
+		m_buffer.resize(old + buf.Size());
+		buf.CopyTo(m_buffer.data() + old, buf.Size());
+		return *this;
+	}
 
 	Pack & push_uint8(uint8_t u8)
 	{
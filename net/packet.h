@@ -170,6 +170,47 @@ public:
         m_packetHeader.setSeq(seq);
     }
 
+    //serialize之后改写包头里的序号
+    void replaceSeq(uint32_t seq){
+        m_packetHeader.setSeq(seq);
+        headPack.replace_uint32(4, seq);
+    }
+
+    //把打好的包拷贝到IOBuf，之后发给多个连接时共享这一份，不再拷贝
+    IOBuf toIOBuf()
+    {
+        IOBuf buf;
+        if(!buf.Append(data(), size())) throw PackError("toIOBuf alloc failed");
+        return buf;
+    }
+
+    /**
+     * @brief 包体已经在IOBuf里时使用：按当前的包头字段生成包头，放在body前面返回，包体不拷贝。
+     * body是std::move进来的并且前面有预留空间时，包头直接写在预留空间里，否则包头单独占一片。
+     * 不计算校验码，也不改动Encoder自己的缓冲区
+     */
+    IOBuf serialize(uint16_t subCmd, IOBuf body)
+    {
+        size_t len = MAIN_PROTO_HEADER_SIZE + SUB_PROTO_HEADER_SIZE + body.Size();
+        if(len > MAX_PACKET_SIZE) throw PackError("serialize body too big");
+        m_packetHeader.setLength(len);
+        m_packetHeader.setSubCmd(subCmd);
+        m_packetHeader.setCheckCode(0);
+        char head[MAIN_PROTO_HEADER_SIZE + SUB_PROTO_HEADER_SIZE];
+        uint16_t u16 = XHTONS(m_packetHeader.getLength());
+        memcpy(head, &u16, 2);
+        u16 = XHTONS(m_packetHeader.getMainCmd());
+        memcpy(head + 2, &u16, 2);
+        uint32_t u32 = XHTONL(m_packetHeader.getSeq());
+        memcpy(head + 4, &u32, 4);
+        u16 = XHTONS(m_packetHeader.getSubCmd());
+        memcpy(head + 8, &u16, 2);
+        u16 = XHTONS(m_packetHeader.getCheckCode());
+        memcpy(head + 10, &u16, 2);
+        if(!body.Prepend(head, sizeof(head))) throw PackError("serialize alloc failed");
+        return body;
+    }
+
     void serialize(uint16_t subCmd, const Marshallable &m, uint16_t (*check_code_func)(char* data, size_t size) = nullptr)
     {
         m.marshal(bodyPack);
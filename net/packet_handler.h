@@ -8,9 +8,29 @@ namespace deps{
  */
 class SocketBase;
 
+//TCP收到的数据怎么分包后交给HandlePacket
+enum class FrameType{
+    raw,        //不分包，缓存的数据整个交给HandlePacket，返回值是处理掉的长度，小于0表示解包失败
+    proto,      //按ProtoHeader的m_length分包，每个完整的包调用一次HandlePacket，返回值小于0表示解包失败
+};
+
 class PacketHandler{
 public:
     virtual int	HandlePacket(const char* data, size_t size, SocketBase* s) = 0;
 	virtual void HandleClose(SocketBase* s) = 0;
+    virtual FrameType GetFrameType(){return FrameType::raw;}
+    //SendFile的文件发送了一部分，sent是已经发送的长度，total是总长度
+    virtual void HandleFileProgress(SocketBase* s, int fd, size_t sent, size_t total){}
+    //SendFile的文件发送结束，success为false表示连接关闭时还没发完；回调之后才可以关闭fd
+    virtual void HandleFileComplete(SocketBase* s, int fd, bool success){}
+    //发送队列涨到高水位，size是当前长度，生产者应该暂停发送
+    virtual void HandleHighWaterMark(SocketBase* s, size_t size){}
+    //发送队列从高水位降到低水位，可以继续发送
+    virtual void HandleLowWaterMark(SocketBase* s, size_t size){}
+    /**
+     * @brief TCP连接处理完一次读写事件后，接收缓冲区没有剩余数据、发送队列已经发完时是否释放这两个对象。
+     * 大量空闲长连接时返回true，空闲连接只占连接对象本身；代价是下次有剩余数据或者待发数据时重新分配
+     */
+    virtual bool ReleaseIdleBuffers(){return false;}
 };
 }
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "blockbuffer.h"
+
+namespace deps{
+/**
+ * @brief 环形缓冲区：和BlockBuffer一样按块分配、受最大块数限制，append/erase/data的语义也相同，
+ * 区别是erase(0, n)只移动读位置，不再把剩下的数据搬到前面，部分消费的代价和剩余数据量无关。
+ * 数据在缓冲区末尾回绕时分成两段：spans/freespans取两段的视图，read_from/write_to用readv/writev直接读写两段；
+ * data()需要连续内存，回绕时先把数据整理成一段，每写满一圈最多整理一次。
+ */
+template <typename BlockAllocator = def_block_alloc_4k, unsigned MaxBlocks = 4, typename GrowthPolicy = geometric_growth>
+class RingBuffer
+{
+public:
+    typedef BlockAllocator allocator;
+    typedef GrowthPolicy growth_policy;
+    enum { max_blocks = MaxBlocks };
+    enum { npos = size_t(-1) };
+
+    RingBuffer()  { m_maxblocks = max_blocks; m_block = 0; m_head = 0; m_size = 0; m_data = NULL; m_role = BUFFER_ROLE_OTHER; }
+    virtual ~RingBuffer() { free(); }
+
+    inline bool   empty() const	 { return size() == 0; }
+    inline size_t block() const	 { return m_block; }
+    inline size_t blocksize() const { return allocator::requested_size; }
+    inline size_t capacity() const  { return m_block * allocator::requested_size; }
+    inline size_t maxsize() const	 { return m_maxblocks * allocator::requested_size; }
+    inline size_t maxfree() const	 { return maxsize() - size(); }
+    inline size_t freespace() const { return capacity() - size(); }
+    //数据是否回绕成了两段
+    inline bool   wrapped() const	 { return m_head + m_size > capacity(); }
+
+    //连续的数据，回绕时先整理成一段
+    char * data();
+    inline size_t size() const	 { return m_size; }
+
+    bool reserve(size_t n);
+    bool append(const char * app, size_t len);
+    void erase(size_t pos=0, size_t n=npos, bool hold=false);
+
+    //数据的两段视图，返回段数
+    int spans(struct iovec iov[2]);
+    //空闲空间的两段视图，返回段数；写入n字节后调用commit(n)
+    int freespans(struct iovec iov[2]);
+    void commit(size_t n) { assert(n <= freespace()); m_size += n; }
+
+    //用readv从fd读最多n字节追加到尾部，空闲空间不够时先扩容，返回值同readv
+    ssize_t read_from(int fd, size_t n);
+    //用writev把数据写到fd，写出去的部分从头部删除，返回值同writev
+    ssize_t write_to(int fd);
+
+    size_t get_max_blocks() { return m_maxblocks; }
+    void set_max_blocks(size_t maxBlocks) { if(maxBlocks > max_blocks) maxBlocks = max_blocks; m_maxblocks = maxBlocks; }
+
+    // 用途见BufferRole，用于内存登记的分类，已经分配的容量转到新用途下
+    void set_role(int role);
+    int  get_role() const { return m_role; }
+
+    // 这种缓冲区当前占用的块数，汇总所有线程，见BufferMemory
+    static size_t current_total_blocks() { return BufferMemory::TypeBytes(type_id()) / allocator::requested_size; }
+    static int type_id() { static int id = BufferMemory::RegisterType(typeid(RingBuffer)); return id; }
+
+protected:
+    bool increase_capacity(size_t increase_size);
+    /**
+     * 没有回绕时用ordered_realloc扩展，数据的位置不变，能原地扩展就不拷贝；
+     * 回绕时数据在新块里要重新排列，分配新块按顺序拷贝，读位置回到开头
+     */
+    char * alloc_blocks(size_t newblock);
+
+private:
+    void free();
+    //第pos个字节在块里的位置
+    size_t offset(size_t pos) const { size_t o = m_head + pos; return o >= capacity() ? o - capacity() : o; }
+    //把两段数据整理成从块开头开始的一段
+    void linearize();
+    //把数据按顺序拷贝到dst
+    void copy_to(char * dst) const;
+
+    char * m_data;
+    size_t m_head;
+    size_t m_size;
+    size_t m_block;
+    size_t m_maxblocks;
+    int m_role;
+
+    RingBuffer(const RingBuffer&);
+    void operator = (const RingBuffer &);
+};
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::free()
+{
+    if (m_block > 0)
+    {
+        allocator::ordered_free(m_data, m_block);
+        BufferMemory::Add(type_id(), m_role, -(int64_t)capacity());
+        m_data = NULL;
+        m_block = 0;
+        m_head = 0;
+    }
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::copy_to(char * dst) const
+{
+    size_t first = std::min(m_size, capacity() - m_head);
+    memcpy(dst, m_data + m_head, first);
+    memcpy(dst + first, m_data, m_size - first);
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::linearize()
+{
+    size_t first = capacity() - m_head;
+    size_t second = m_size - first;
+    if (m_size <= m_head)
+    {	// 前面的空闲空间放得下：第二段后移，第一段拷到开头，一共拷贝size字节
+        memmove(m_data + first, m_data, second);
+        memcpy(m_data, m_data + m_head, first);
+    }
+    else
+    {	// 较短的一段先放到临时内存，较长的一段只搬移一次；原地旋转要慢几倍，只在分配失败时使用
+        size_t n = std::min(first, second);
+        char * tmp = (char*)::malloc(n);
+        if (NULL == tmp)
+            std::rotate(m_data, m_data + m_head, m_data + capacity());
+        else if (second <= first)
+        {
+            memcpy(tmp, m_data, second);
+            memmove(m_data, m_data + m_head, first);
+            memcpy(m_data + first, tmp, second);
+        }
+        else
+        {
+            memcpy(tmp, m_data + m_head, first);
+            memmove(m_data + first, m_data, second);
+            memcpy(m_data, tmp, first);
+        }
+        ::free(tmp);
+    }
+    m_head = 0;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline char * RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::data()
+{
+    if (wrapped())
+        linearize();
+    return m_data + m_head;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::reserve(size_t n)
+{
+    return (n <= capacity() || increase_capacity(n - capacity()));
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::append(const char * app, size_t len)
+{
+    if (len == 0)
+        return true; // no data
+
+    if (!increase_capacity(len))
+        return false;
+    // 要回绕时空闲空间比数据少，data()整理的代价摊不开，尽量扩容到空闲空间不少于数据量；失败就按原容量回绕
+    if (m_head + m_size + len > capacity() && freespace() < m_size + 2 * len)
+        increase_capacity(m_size + 2 * len);
+    size_t tail = offset(m_size);
+    size_t first = std::min(len, capacity() - tail);
+    memmove(m_data + tail, app, first);
+    memmove(m_data, app + first, len - first);
+    m_size += len;
+    return true;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::erase(size_t pos, size_t n, bool hold)
+{
+    assert(pos <= size()); // out_of_range debug.
+
+    size_t m = size() - pos; // can erase
+    if (n >= m)
+        m_size = pos; // all clear after pos
+    else if (pos == 0)
+    {	// 只移动读位置
+        m_head = offset(n);
+        m_size -= n;
+    }
+    else
+    {	// 从中间删除很少见，整理成一段后和BlockBuffer一样搬移
+        char * p = data();
+        memmove(p + pos, p + pos + n, m - n);
+        m_size -= n;
+    }
+
+    if (empty())
+    {
+        m_head = 0;
+        if (!hold)
+            free();
+    }
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline int RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::spans(struct iovec iov[2])
+{
+    if (empty())
+        return 0;
+    size_t first = std::min(m_size, capacity() - m_head);
+    iov[0].iov_base = m_data + m_head;
+    iov[0].iov_len = first;
+    if (first == m_size)
+        return 1;
+    iov[1].iov_base = m_data;
+    iov[1].iov_len = m_size - first;
+    return 2;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline int RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::freespans(struct iovec iov[2])
+{
+    size_t free = freespace();
+    if (free == 0)
+        return 0;
+    size_t tail = offset(m_size);
+    size_t first = std::min(free, capacity() - tail);
+    iov[0].iov_base = m_data + tail;
+    iov[0].iov_len = first;
+    if (first == free)
+        return 1;
+    iov[1].iov_base = m_data;
+    iov[1].iov_len = free - first;
+    return 2;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline ssize_t RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::read_from(int fd, size_t n)
+{
+    if (n == 0)
+        return 0;
+    // 扩容失败时用剩下的空闲空间
+    if (!increase_capacity(n) && freespace() == 0)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+    struct iovec iov[2];
+    int cnt = freespans(iov);
+    if (iov[0].iov_len >= n)
+    {
+        iov[0].iov_len = n;
+        cnt = 1;
+    }
+    else if (cnt == 2 && iov[0].iov_len + iov[1].iov_len > n)
+        iov[1].iov_len = n - iov[0].iov_len;
+    ssize_t ret = ::readv(fd, iov, cnt);
+    if (ret > 0)
+        m_size += ret;
+    return ret;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline ssize_t RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::write_to(int fd)
+{
+    struct iovec iov[2];
+    int cnt = spans(iov);
+    if (cnt == 0)
+        return 0;
+    ssize_t ret = ::writev(fd, iov, cnt);
+    if (ret > 0)
+        erase(0, ret);
+    return ret;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline char * RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::alloc_blocks(size_t newblock)
+{
+    if (m_block == 0)
+        return allocator::ordered_malloc(newblock);
+    if (!wrapped())
+        return allocator::ordered_realloc(m_data, m_block, newblock, m_head + m_size);
+    char * newdata = allocator::ordered_malloc(newblock);
+    if (newdata)
+    {
+        copy_to(newdata);
+        allocator::ordered_free(m_data, m_block);
+        m_head = 0;
+    }
+    return newdata;
+}
+
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline void RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::set_role(int role)
+{
+    if (m_block > 0)
+    {
+        BufferMemory::Add(type_id(), m_role, -(int64_t)capacity());
+        BufferMemory::Add(type_id(), role, (int64_t)capacity());
+    }
+    m_role = role;
+}
+
+/*
+* after success increase_capacity : freespace() >= increase_size
+* if false : does not affect exist data
+*/
+template <typename BlockAllocator, unsigned MaxBlocks, typename GrowthPolicy>
+inline bool RingBuffer<BlockAllocator, MaxBlocks, GrowthPolicy >::increase_capacity(size_t increase_size)
+{
+    if (increase_size == 0) return true;
+
+    size_t newblock = m_block;
+
+    size_t free = freespace();
+    if (free >= increase_size) return true;
+    increase_size -= free;
+    newblock += increase_size / allocator::requested_size;
+    if ((increase_size % allocator::requested_size) > 0)
+        newblock ++;
+
+    if (newblock > m_maxblocks) return false;
+    size_t needblock = newblock;
+    newblock = std::min(std::max(growth_policy::grow(m_block, needblock), needblock), m_maxblocks);
+
+    char * newdata = alloc_blocks(newblock);
+    if (0 == newdata && newblock > needblock)
+    {	// 按增长策略分配失败时只要需要的块数
+        newblock = needblock;
+        newdata = alloc_blocks(newblock);
+    }
+    if (0 == newdata) return false;
+
+    BufferMemory::Add(type_id(), m_role, (int64_t)(newblock - m_block) * allocator::requested_size);
+
+    m_data = newdata;
+    m_block = newblock;
+    return true;
+}
+}
@@ -0,0 +1,186 @@
+#include <cstring>
+#include <memory>
+#include "rpc_client.h"
+#include "tcp_socket.h"
+
+using namespace deps;
+
+RpcClient::RpcClient(SocketContainer* container, uint32_t ip, int port, PacketHandler* handler){
+    m_container = container;
+    m_ip = ip;
+    m_port = port;
+    m_handler = handler;
+    m_socket = nullptr;
+    m_nextSeq = 0;
+}
+
+RpcClient::~RpcClient(){
+    Close();
+    m_container = nullptr;
+    m_handler = nullptr;
+}
+
+uint32_t RpcClient::Call(Encoder& enc, uint64_t timeoutMs, const Callback& cb){
+    uint32_t seq = NextSeq();
+    enc.replaceSeq(seq);
+    return Send(seq, enc.data(), enc.size(), timeoutMs, cb);
+}
+
+uint32_t RpcClient::Call(const char* data, size_t size, uint64_t timeoutMs, const Callback& cb){
+    if(nullptr == data || size < Decoder::minSize()){
+        LOG_ERROR("rpc %s:%u invalid request size:%zu", UintIP2String(m_ip).c_str(), m_port, size);
+        m_stats.m_failCount++;
+        if(cb){
+            cb(RpcStatus::failed, nullptr, 0);
+        }
+        return 0;
+    }
+    uint32_t seq = NextSeq();
+    std::string packet(data, size);
+    uint32_t netSeq = XHTONL(seq);
+    memcpy(&packet[4], &netSeq, sizeof(netSeq));
+    return Send(seq, packet.data(), packet.size(), timeoutMs, cb);
+}
+
+std::future<RpcReply> RpcClient::CallFuture(Encoder& enc, uint64_t timeoutMs){
+    std::shared_ptr<std::promise<RpcReply>> promise = std::make_shared<std::promise<RpcReply>>();
+    std::future<RpcReply> future = promise->get_future();
+    std::shared_ptr<std::string> packet = std::make_shared<std::string>(enc.data(), enc.size());
+    bool posted = m_container->Post([this, packet, timeoutMs, promise](){
+        Call(packet->data(), packet->size(), timeoutMs, [promise](RpcStatus status, const char* data, size_t size){
+            RpcReply reply;
+            reply.m_status = status;
+            if(RpcStatus::ok == status){
+                reply.m_data.assign(data, size);
+            }
+            promise->set_value(reply);
+        });
+    });
+    if(!posted){
+        RpcReply reply;
+        reply.m_status = RpcStatus::failed;
+        promise->set_value(reply);
+    }
+    return future;
+}
+
+void RpcClient::Close(){
+    if(nullptr != m_socket){
+        //HandleClose里回调所有未完成的请求
+        m_socket->Close();
+    }
+    FailAll(RpcStatus::closed);
+}
+
+int RpcClient::HandlePacket(const char* data, size_t size, SocketBase* s){
+    uint32_t seq = Decoder::pickSeq(data);
+    std::unordered_map<uint32_t, PendingCall*>::iterator it = m_calls.find(seq);
+    if(it == m_calls.end()){
+        m_stats.m_unmatchedCount++;
+        if(m_handler){
+            return m_handler->HandlePacket(data, size, s);
+        }
+        LOG_DEBUG("rpc %s:%u seq:%u no pending call, dropped", UintIP2String(m_ip).c_str(), m_port, seq);
+        return size;
+    }
+    PendingCall* call = it->second;
+    m_calls.erase(it);
+    m_container->DelTimer(&call->m_timer);
+    m_stats.m_replyCount++;
+    //回调里可能发起新的请求或者关闭连接
+    if(call->m_callback){
+        call->m_callback(RpcStatus::ok, data, size);
+    }
+    delete call;
+    return size;
+}
+
+void RpcClient::HandleClose(SocketBase* s){
+    if(s != m_socket){
+        return;
+    }
+    LOG_DEBUG("rpc %s:%u connection closed, pending:%zu", UintIP2String(m_ip).c_str(), m_port, m_calls.size());
+    m_socket = nullptr;
+    FailAll(RpcStatus::closed);
+}
+
+void RpcClient::OnTimeout(TimerNode* node, void* arg){
+    PendingCall* call = (PendingCall*)arg;
+    RpcClient* client = call->m_client;
+    client->m_calls.erase(call->m_seq);
+    client->m_stats.m_timeoutCount++;
+    LOG_DEBUG("rpc %s:%u seq:%u timeout", UintIP2String(client->m_ip).c_str(), client->m_port, call->m_seq);
+    if(call->m_callback){
+        call->m_callback(RpcStatus::timeout, nullptr, 0);
+    }
+    delete call;
+}
+
+bool RpcClient::EnsureConnected(){
+    if(nullptr != m_socket){
+        return true;
+    }
+    SocketBase* s = TcpSocket::Connect(m_ip, m_port, m_container, this);
+    if(nullptr == s){
+        LOG_ERROR("rpc %s:%u connect failed", UintIP2String(m_ip).c_str(), m_port);
+        return false;
+    }
+    m_socket = (TcpSocket*)s;
+    return true;
+}
+
+uint32_t RpcClient::NextSeq(){
+    //0表示失败，跳过；序号回绕后跳过还没完成的
+    do{
+        ++m_nextSeq;
+    }while(0 == m_nextSeq || m_calls.count(m_nextSeq) > 0);
+    return m_nextSeq;
+}
+
+uint32_t RpcClient::Send(uint32_t seq, const char* data, size_t size, uint64_t timeoutMs, const Callback& cb){
+    if(!EnsureConnected() || !m_socket->SendPacket(data, size)){
+        m_stats.m_failCount++;
+        if(cb){
+            cb(RpcStatus::failed, nullptr, 0);
+        }
+        return 0;
+    }
+    //发送过程中连接可能已经关闭，这时请求不再登记
+    if(nullptr == m_socket){
+        m_stats.m_failCount++;
+        if(cb){
+            cb(RpcStatus::closed, nullptr, 0);
+        }
+        return 0;
+    }
+    PendingCall* call = new PendingCall();
+    call->m_timer.m_callback = OnTimeout;
+    call->m_timer.m_arg = call;
+    call->m_seq = seq;
+    call->m_callback = cb;
+    call->m_client = this;
+    m_calls[seq] = call;
+    if(timeoutMs > 0){
+        m_container->AddTimer(&call->m_timer, timeoutMs);
+    }
+    m_stats.m_callCount++;
+    return seq;
+}
+
+void RpcClient::FailAll(RpcStatus status){
+    if(m_calls.empty()){
+        return;
+    }
+    //回调里可能发起新的请求，先把未完成的请求换出来
+    std::unordered_map<uint32_t, PendingCall*> calls;
+    calls.swap(m_calls);
+    for(std::unordered_map<uint32_t, PendingCall*>::iterator it = calls.begin(); it != calls.end(); ++it){
+        PendingCall* call = it->second;
+        m_container->DelTimer(&call->m_timer);
+        m_stats.m_failCount++;
+        if(call->m_callback){
+            call->m_callback(status, nullptr, 0);
+        }
+        delete call;
+    }
+}
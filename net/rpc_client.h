@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <functional>
+#include <future>
+#include <unordered_map>
+
+#include "socket_container.h"
+#include "packet_handler.h"
+#include "packet.h"
+#include "timing_wheel.h"
+
+namespace deps{
+class TcpSocket;
+
+enum class RpcStatus{
+    ok,         //收到应答
+    timeout,    //超时没有收到应答
+    closed,     //连接关闭时还没有收到应答
+    failed,     //连接或者发送失败
+};
+
+//CallFuture的结果
+struct RpcReply{
+    RpcStatus m_status;
+    std::string m_data;     //完整的应答包(包括包头)，m_status不是ok时为空
+};
+
+//调用统计，只在事件循环线程里累加
+struct RpcStats{
+    RpcStats():m_callCount(0), m_replyCount(0), m_timeoutCount(0), m_failCount(0), m_unmatchedCount(0){}
+    uint64_t m_callCount;       //发出的请求数
+    uint64_t m_replyCount;      //按序号匹配到请求的应答数
+    uint64_t m_timeoutCount;    //超时的请求数
+    uint64_t m_failCount;       //连接关闭或者发送失败的请求数
+    uint64_t m_unmatchedCount;  //没有匹配到请求的包数(超时后才到的应答、服务端推送)
+};
+
+/**
+ * @brief 客户端调用层：一个TCP连接上按ProtoHeader的m_seq匹配请求和应答。
+ * 每个请求分配一个不重复的序号，不等应答就可以继续发送，应答按到达的顺序回调，不要求和请求顺序一致；
+ * 每个请求的超时挂在容器的时间轮上，到期回调RpcStatus::timeout，不需要扫描。
+ * 连接在第一次调用时建立，断开后所有未完成的请求回调RpcStatus::closed，下一次调用时重连；
+ * 连接建立之前发出的请求先在发送队列里排队。
+ * 除了CallFuture，其他接口都只能在容器的事件循环线程里调用。
+ */
+class RpcClient: public PacketHandler{
+public:
+    //data、size是完整的应答包，status不是ok时为空
+    typedef std::function<void(RpcStatus status, const char* data, size_t size)> Callback;
+
+    /**
+     * @param handler 没有匹配到请求的包(超时后才到的应答、服务端推送)交给handler，为nullptr时丢弃
+     */
+    RpcClient(SocketContainer* container, uint32_t ip, int port, PacketHandler* handler = nullptr);
+    virtual ~RpcClient();
+    RpcClient(const RpcClient&)=delete;
+    RpcClient& operator=(const RpcClient&)=delete;
+
+    /**
+     * @brief 发送请求，enc的序号会被改写成分配的序号。timeoutMs毫秒内没有应答回调RpcStatus::timeout，
+     * 0表示不超时。返回分配的序号，失败时返回0，这时cb已经以RpcStatus::failed回调过
+     */
+    uint32_t Call(Encoder& enc, uint64_t timeoutMs, const Callback& cb);
+    //同上，data是序列化好的完整请求包，拷贝后改写序号
+    uint32_t Call(const char* data, size_t size, uint64_t timeoutMs, const Callback& cb);
+    /**
+     * @brief 可以在任何线程调用：拷贝请求包后投递到事件循环线程发送，结果通过future返回。
+     * 不能在事件循环线程里等待返回的future，否则会死锁
+     */
+    std::future<RpcReply> CallFuture(Encoder& enc, uint64_t timeoutMs);
+    //主动断开连接，未完成的请求回调RpcStatus::closed
+    void Close();
+    size_t GetPendingCount(){return m_calls.size();}
+    const RpcStats& GetStats(){return m_stats;}
+
+    virtual int HandlePacket(const char* data, size_t size, SocketBase* s);
+    virtual void HandleClose(SocketBase* s);
+    virtual FrameType GetFrameType(){return FrameType::proto;}
+private:
+    struct PendingCall{
+        TimerNode m_timer;
+        uint32_t m_seq;
+        Callback m_callback;
+        RpcClient* m_client;
+    };
+    static void OnTimeout(TimerNode* node, void* arg);
+    bool EnsureConnected();
+    uint32_t NextSeq();
+    //登记请求并发送，data里的序号已经是seq
+    uint32_t Send(uint32_t seq, const char* data, size_t size, uint64_t timeoutMs, const Callback& cb);
+    //所有未完成的请求以status回调
+    void FailAll(RpcStatus status);
+private:
+    SocketContainer* m_container;
+    uint32_t m_ip;
+    int m_port;
+    PacketHandler* m_handler;
+    TcpSocket* m_socket;                                    //当前连接，没有连接时为nullptr
+    uint32_t m_nextSeq;
+    std::unordered_map<uint32_t, PendingCall*> m_calls;     //序号->未完成的请求
+    RpcStats m_stats;
+};
+}
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include "send_queue.h"
+#include "buffer_memory.h"
+
+using namespace deps;
+
+namespace{
+//拷贝数据用的块记到内存登记的发送队列用途下
+int SendQueueTypeId(){
+    static int id = BufferMemory::RegisterType("SendQueue");
+    return id;
+}
+}
+
+SendQueue::SendQueue(size_t maxSize){
+    m_size = 0;
+    m_fileSize = 0;
+    m_maxSize = maxSize;
+}
+
+SendQueue::~SendQueue(){
+    Clear();
+}
+
+bool SendQueue::Append(const char* data, size_t size){
+    if(nullptr == data || size < 1){
+        return true;
+    }
+    if(m_size - m_fileSize + size > m_maxSize){
+        return false;
+    }
+    //尾部的块还放得下就直接追加
+    if(!m_segments.empty()){
+        Segment& tail = m_segments.back();
+        if(nullptr != tail.m_block){
+            char* end = (char*)tail.m_data + tail.m_size;
+            if(!tail.m_zeroCopy && end + size <= tail.m_block + tail.m_capacity){
+                memcpy(end, data, size);
+                tail.m_size += size;
+                tail.m_total += size;
+                m_size += size;
+                return true;
+            }
+        }
+    }
+    Segment seg;
+    seg.m_capacity = size > SEND_QUEUE_BLOCK_SIZE ? size : SEND_QUEUE_BLOCK_SIZE;
+    seg.m_block = (char*)malloc(seg.m_capacity);
+    if(nullptr == seg.m_block){
+        return false;
+    }
+    BufferMemory::Add(SendQueueTypeId(), BUFFER_ROLE_SOCKET_OUTPUT, seg.m_capacity);
+    memcpy(seg.m_block, data, size);
+    seg.m_data = seg.m_block;
+    seg.m_size = size;
+    seg.m_total = size;
+    m_segments.push_back(seg);
+    m_size += size;
+    return true;
+}
+
+bool SendQueue::Append(const char* data, size_t size, const std::function<void()>& release){
+    if(nullptr == data || size < 1){
+        if(release){
+            release();
+        }
+        return true;
+    }
+    if(m_size - m_fileSize + size > m_maxSize){
+        return false;
+    }
+    Segment seg;
+    seg.m_data = data;
+    seg.m_size = size;
+    seg.m_total = size;
+    seg.m_release = release;
+    m_segments.push_back(seg);
+    m_size += size;
+    return true;
+}
+
+bool SendQueue::AppendFile(int fd, off_t offset, size_t size, const std::function<void(bool)>& complete){
+    if(fd < 0){
+        return false;
+    }
+    if(size < 1){
+        if(complete){
+            complete(true);
+        }
+        return true;
+    }
+    Segment seg;
+    seg.m_size = size;
+    seg.m_total = size;
+    seg.m_fileFd = fd;
+    seg.m_fileOffset = offset;
+    seg.m_complete = complete;
+    m_segments.push_back(seg);
+    m_size += size;
+    m_fileSize += size;
+    return true;
+}
+
+bool SendQueue::FrontFile(int* fd, off_t* offset, size_t* size, size_t* total){
+    if(m_segments.empty() || m_segments.front().m_fileFd < 0){
+        return false;
+    }
+    Segment& seg = m_segments.front();
+    *fd = seg.m_fileFd;
+    *offset = seg.m_fileOffset;
+    *size = seg.m_size;
+    *total = seg.m_total;
+    return true;
+}
+
+int SendQueue::GetIov(struct iovec* iov, int maxIov){
+    int n = 0;
+    for(std::deque<Segment>::iterator it = m_segments.begin(); it != m_segments.end() && n < maxIov; ++it){
+        if(it->m_fileFd >= 0){
+            break;
+        }
+        iov[n].iov_base = (void*)it->m_data;
+        iov[n].iov_len = it->m_size;
+        ++n;
+    }
+    return n;
+}
+
+int SendQueue::GetIov(struct iovec* iov, int maxIov, size_t zeroCopyThreshold, bool* zeroCopy){
+    *zeroCopy = false;
+    int n = 0;
+    for(std::deque<Segment>::iterator it = m_segments.begin(); it != m_segments.end() && n < maxIov; ++it){
+        if(it->m_fileFd >= 0){
+            break;
+        }
+        if(zeroCopyThreshold > 0 && it->m_total >= zeroCopyThreshold){
+            if(0 == n){
+                iov[n].iov_base = (void*)it->m_data;
+                iov[n].iov_len = it->m_size;
+                *zeroCopy = true;
+                ++n;
+            }
+            break;
+        }
+        iov[n].iov_base = (void*)it->m_data;
+        iov[n].iov_len = it->m_size;
+        ++n;
+    }
+    return n;
+}
+
+void SendQueue::Consume(size_t n){
+    Consume(n, false, 0);
+}
+
+void SendQueue::ConsumeZeroCopy(size_t n, uint32_t id){
+    Consume(n, true, id);
+}
+
+void SendQueue::Consume(size_t n, bool zeroCopy, uint32_t id){
+    while(n > 0 && !m_segments.empty()){
+        Segment& seg = m_segments.front();
+        if(zeroCopy){
+            seg.m_zeroCopy = true;
+            seg.m_zeroCopyId = id;
+        }
+        bool isFile = seg.m_fileFd >= 0;
+        if(n < seg.m_size){
+            if(isFile){
+                seg.m_fileOffset += n;
+                m_fileSize -= n;
+            }
+            else{
+                seg.m_data += n;
+            }
+            seg.m_size -= n;
+            m_size -= n;
+            return;
+        }
+        n -= seg.m_size;
+        m_size -= seg.m_size;
+        if(isFile){
+            m_fileSize -= seg.m_size;
+        }
+        seg.m_size = 0;
+        //释放函数里可能再次操作队列，先从队列里摘下来再释放
+        Segment done = seg;
+        m_segments.pop_front();
+        if(done.m_zeroCopy){
+            //内核还在引用这段内存
+            m_zeroCopySegments.push_back(done);
+            continue;
+        }
+        Release(done);
+    }
+}
+
+size_t SendQueue::CompleteZeroCopy(uint32_t id){
+    size_t bytes = 0;
+    //序号会回绕，按差值比较
+    while(!m_zeroCopySegments.empty() && (int32_t)(m_zeroCopySegments.front().m_zeroCopyId - id) <= 0){
+        Segment done = m_zeroCopySegments.front();
+        m_zeroCopySegments.pop_front();
+        bytes += done.m_total;
+        Release(done);
+    }
+    return bytes;
+}
+
+void SendQueue::Clear(){
+    while(!m_segments.empty()){
+        Segment done = m_segments.front();
+        m_segments.pop_front();
+        m_size -= done.m_size;
+        if(done.m_fileFd >= 0){
+            m_fileSize -= done.m_size;
+        }
+        Release(done);
+    }
+    while(!m_zeroCopySegments.empty()){
+        Segment done = m_zeroCopySegments.front();
+        m_zeroCopySegments.pop_front();
+        Release(done);
+    }
+}
+
+void SendQueue::Release(Segment& seg){
+    if(nullptr != seg.m_block){
+        free(seg.m_block);
+        BufferMemory::Add(SendQueueTypeId(), BUFFER_ROLE_SOCKET_OUTPUT, -(int64_t)seg.m_capacity);
+        seg.m_block = nullptr;
+    }
+    if(seg.m_release){
+        seg.m_release();
+    }
+    if(seg.m_complete){
+        //剩余长度为0说明文件段已经全部发完
+        seg.m_complete(0 == seg.m_size);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace deps{
+/**
+ * @brief 发送队列：由若干段组成的链表，发送时用writev一次提交多段，
+ * 发送一部分后只移动段内偏移，不再像连续缓冲区那样把剩余数据搬到前面。
+ * 拷贝进来的小包合并到SEND_QUEUE_BLOCK_SIZE大小的块里；
+ * 转交所有权的数据直接作为一段挂在队列上，发完或者清空时调用release释放。
+ * 用MSG_ZEROCOPY发送过的段发完后不能马上释放，内核还在引用这段内存，
+ * 先挂到零拷贝等待队列上，等内核通知完成(CompleteZeroCopy)后再释放。
+ * 文件段只记录描述符和位置，由使用者用sendfile发送，数据不经过用户态，不计入最大长度。
+ */
+class SendQueue{
+public:
+    enum { SEND_QUEUE_BLOCK_SIZE = 4096 };
+
+    SendQueue(size_t maxSize);
+    ~SendQueue();
+    SendQueue(const SendQueue&)=delete;
+    SendQueue& operator=(const SendQueue&)=delete;
+
+    //拷贝数据到队列尾部，超过最大长度或者内存不够时返回false
+    bool Append(const char* data, size_t size);
+    //数据所有权转交给队列，不拷贝；失败时返回false，所有权仍归调用者
+    bool Append(const char* data, size_t size, const std::function<void()>& release);
+    //文件fd从offset开始的size字节，发完时complete(true)，没发完就被清空时complete(false)
+    bool AppendFile(int fd, off_t offset, size_t size, const std::function<void(bool)>& complete);
+    //队头是文件段时返回true，并取出待发送的位置、剩余长度和总长度；GetIov在文件段之前停下
+    bool FrontFile(int* fd, off_t* offset, size_t* size, size_t* total);
+    //从队头开始最多填充maxIov段待发送数据，返回填充的段数
+    int  GetIov(struct iovec* iov, int maxIov);
+    /**
+     * @brief 同上，但是区分零拷贝的段：队头的段不小于zeroCopyThreshold时只返回这一段，*zeroCopy置为true；
+     * 否则在第一个不小于zeroCopyThreshold的段之前停下，*zeroCopy置为false
+     */
+    int  GetIov(struct iovec* iov, int maxIov, size_t zeroCopyThreshold, bool* zeroCopy);
+    //已经发送了n个字节，释放发完的段
+    void Consume(size_t n);
+    //已经用MSG_ZEROCOPY发送了n个字节，id是这次发送的完成通知序号，发完的段等通知后再释放
+    void ConsumeZeroCopy(size_t n, uint32_t id);
+    //内核通知序号不大于id的零拷贝发送都已经完成(TCP按顺序完成)，释放对应的段，返回释放的字节数
+    size_t CompleteZeroCopy(uint32_t id);
+    //丢弃所有数据并释放所有段，包括还在等零拷贝完成通知的段
+    void Clear();
+    size_t Size() const {return m_size;}
+    bool Empty() const {return 0 == m_size;}
+    size_t MaxSize() const {return m_maxSize;}
+    //还能放进队列的长度(文件段不计入)
+    size_t Available() const {return m_maxSize - (m_size - m_fileSize);}
+    //还在等零拷贝完成通知的段数
+    size_t ZeroCopyPending() const {return m_zeroCopySegments.size();}
+private:
+    struct Segment{
+        Segment():m_block(nullptr), m_capacity(0), m_data(nullptr), m_size(0), m_total(0),
+            m_zeroCopy(false), m_zeroCopyId(0), m_fileFd(-1), m_fileOffset(0){}
+        char* m_block;                      //拷贝数据用的块，转交所有权的段为nullptr
+        size_t m_capacity;                  //块大小
+        const char* m_data;                 //待发送数据起始位置
+        size_t m_size;                      //待发送数据长度
+        size_t m_total;                     //段的总长度
+        bool m_zeroCopy;                    //是否有数据用MSG_ZEROCOPY发送过
+        uint32_t m_zeroCopyId;              //最后一次零拷贝发送的完成通知序号
+        int m_fileFd;                       //文件段的描述符，其他段为-1
+        off_t m_fileOffset;                 //文件段待发送数据的位置
+        std::function<void()> m_release;    //转交所有权的段发完后的释放函数
+        std::function<void(bool)> m_complete;   //文件段发完或者被清空时的回调
+    };
+    void Consume(size_t n, bool zeroCopy, uint32_t id);
+    static void Release(Segment& seg);
+private:
+    std::deque<Segment> m_segments;
+    std::deque<Segment> m_zeroCopySegments; //已经发完、等零拷贝完成通知的段
+    size_t m_size;                          //待发送数据总长度，包括文件段
+    size_t m_fileSize;                      //文件段待发送数据长度
+    size_t m_maxSize;                       //最大长度
+};
+}
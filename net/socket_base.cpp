@@ -0,0 +1,38 @@
+#include "socket_base.h"
+
+using namespace deps;
+
+bool SocketBase::SendPacket(const char* data, size_t size, const std::function<void()>& release){
+    bool ret = SendPacket(data, size);
+    if(release){
+        release();
+    }
+    return ret;
+}
+
+void SocketBase::UpdateTimer(){
+    if(nullptr == m_container){
+        return;
+    }
+    //已经关闭的连接不能再挂到时间轮上
+    if(m_fd == -1 || m_timeout <= 0 || m_lastAccessTime <= 0){
+        m_container->DelTimer(&m_timer);
+        return;
+    }
+    //HandleTimeout里判断的是 m_lastAccessTime + m_timeout < now，所以到期时间要多算1秒
+    time_t now = time(NULL);
+    time_t remain = m_lastAccessTime + m_timeout + 1 - now;
+    if(remain < 0){
+        remain = 0;
+    }
+    m_container->AddTimer(&m_timer, (uint64_t)remain * 1000);
+}
+
+void SocketBase::OnTimer(TimerNode* node, void* arg){
+    SocketBase* s = (SocketBase*)arg;
+    s->HandleTimeout();
+    //还没超时(期间有访问)就按最新的访问时间重新设置
+    if(s->m_state != SocketState::close && !s->m_timer.IsActive()){
+        s->UpdateTimer();
+    }
+}
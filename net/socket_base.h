@@ -1,11 +1,14 @@
 #pragma once
 
+#include <sys/socket.h>
 #include <netinet/in.h>
 #include <time.h>
 #include <string>
+#include <functional>
 
 #include "socket_container.h"
 #include "packet_handler.h"
+#include "timing_wheel.h"
 
 namespace deps{
 class SocketContainer;
@@ -15,6 +18,19 @@ class SocketContainer;
 #define UDP_RECV_BUFF_SIZE  16*1024*1024  	//16M
 #define UDP_SEND_BUFF_SIZE 	16*1024*1024	//16M
 #define MAX_READ_BUFF_SIZE  65536           //一次read最大读取数据，udp包一次没读完数据就被丢了
+#define ET_READ_BUDGET_SIZE  4*MAX_READ_BUFF_SIZE   //边缘触发模式下单个连接每轮默认最多读取或者发送的数据，见SocketBudget
+#define ACCEPT_BATCH_SIZE    64                     //监听描述符每次唤醒最多接收的连接数
+#define TCP_OUTPUT_MAX_SIZE  4*1024*1024            //TCP发送队列最多缓存的数据
+#define TCP_ZEROCOPY_THRESHOLD 64*1024              //TCP零拷贝发送默认的最小数据段
+#define UDP_BATCH_SIZE       32                     //UDP批量模式下一次recvmmsg/sendmmsg最多处理的数据报个数
+#define UDP_SEND_QUEUE_MAX   4096                   //UDP批量模式下最多缓存的待发送数据报个数
+#define UDP_GSO_MAX_SIZE     65507                  //UDP分段卸载时一个大包最多的数据
+#define UDP_GSO_MAX_SEGMENTS 64                     //UDP分段卸载时一个大包最多切成的数据报个数
+#define TCP_RELAY_PIPE_SIZE  256*1024               //TCP中继每个方向的管道容量
+#define TCP_NOTSENT_LOWAT_SIZE 128*1024             //TCP内核发送队列里没发出去的数据默认上限
+#define BUSY_POLL_SOCKET_US  50                     //忙轮询模式下连接默认的SO_BUSY_POLL时间(微秒)
+#define SOCKET_POOL_SIZE     1024                   //容器回收池里每种连接对象默认最多保留的个数
+#define TCP_IOBUF_SHARE_SIZE 2048                   //TCP发送IOBuf时不小于这个长度的片共享，更小的拷贝进发送队列合并
 
 enum class SocketType{
 	tcp,
@@ -62,14 +78,39 @@ public:
         }
     }
 public:
-    SocketBase(){}
+    SocketBase(){
+        m_id = 0;
+        m_timer.m_callback = OnTimer;
+        m_timer.m_arg = this;
+    }
     virtual ~SocketBase(){}    
 	virtual void HandleRead(char* max_read_buffer, size_t max_read_size) = 0;
 	virtual void HandleWrite() = 0;
     virtual void HandleError() = 0;
     virtual void HandleTimeout() = 0;
+    //通过AddFlushSocket登记后，在本轮事件循环末尾回调
+    virtual void HandleFlush(){}
+    //以下三个由完成式收发的后端回调(见SocketContainer::HasRecvCompletion)
+    //后端收到的数据，data只在回调期间有效；result是字节数，0表示对端关闭，小于0是负的错误码
+    virtual void HandleRecv(const char* data, int result){}
+    //监听描述符上后端接收的新连接描述符，回调负责关闭或者接管
+    virtual void HandleAccept(int fd){}
+    //SubmitSend提交的发送完成，result是发送的字节数或者负的错误码
+    virtual void HandleSendComplete(int result){}
     virtual bool SendPacket(const char* data, size_t size) = 0;
+    /**
+     * @brief 发送数据并转交所有权，不再拷贝，例如发送new出来的Encoder：
+     * s->SendPacket(enc->data(), enc->size(), [enc](){delete enc;});
+     * 无论成功失败release都会被调用一次：发送完成、连接关闭或者发送失败时。
+     * 默认实现是拷贝发送后立即释放。
+     */
+    virtual bool SendPacket(const char* data, size_t size, const std::function<void()>& release);
     virtual void Close() = 0;
+    /**
+     * @brief 连接关闭后由容器调用，重置成刚构造时的状态(保留缓冲区对象)放进回收池，
+     * 之后新建同类型连接时复用。返回false表示不能回收，容器直接delete。
+     */
+    virtual bool Recycle(){return false;}
     void SetFd(int fd){m_fd = fd;}
     int GetFd(){return m_fd;}
     void SetState(SocketState st){m_state = st;}
@@ -77,12 +118,38 @@ public:
     SocketType GetType(){return m_type;}
     void SetCreateTime(time_t time){m_createTime = time;}
     time_t GetCreateTime(){return m_createTime;}
-    void SetLastAccessTime(time_t time){m_lastAccessTime = time;}
+    //访问时间按秒变化时才需要重新设置超时定时器
+    void SetLastAccessTime(time_t time){
+        if(m_lastAccessTime != time){
+            m_lastAccessTime = time;
+            UpdateTimer();
+        }
+    }
     time_t GetLastAccessTime(){return m_lastAccessTime;}
     void SetPeerAddr(struct sockaddr_in addr){m_peerAddr = addr;}
-    struct sockaddr_in GetPeerAddr(){return m_peerAddr;}
-    void SetTimeout(int timeout){m_timeout = timeout>0 ? timeout :0;}
+    struct sockaddr_in GetPeerAddr(){
+        //后端直接接收的连接不带对端地址，第一次用到时再取
+        if(AF_UNSPEC == m_peerAddr.sin_family && -1 != m_fd){
+            socklen_t len = sizeof(m_peerAddr);
+            getpeername(m_fd, (struct sockaddr*)&m_peerAddr, &len);
+        }
+        return m_peerAddr;
+    }
+    void SetTimeout(int timeout){
+        m_timeout = timeout>0 ? timeout :0;
+        UpdateTimer();
+    }
     int GetTimeout(){return m_timeout;}
+    TimerNode* GetTimer(){return &m_timer;}
+    //容器内唯一标识，描述符被复用后也不会重复，用于跨线程投递
+    void SetId(uint64_t id){m_id = id;}
+    uint64_t GetId(){return m_id;}
+    SocketContainer* GetContainer(){return m_container;}
+protected:
+    //根据上次访问时间和超时时间在容器的时间轮上设置、重设或者取消超时定时器
+    void UpdateTimer();
+private:
+    static void OnTimer(TimerNode* node, void* arg);
 protected:
 	int m_fd;	                        //描述符id
 	SocketState m_state;	            //连接状态
@@ -93,5 +160,7 @@ protected:
     int m_timeout;                      //连接超时时间（单位是秒，0表示永不超时）
     SocketContainer *m_container;      	//容器
     PacketHandler* m_handler;           //协议解析
+    TimerNode m_timer;                  //超时定时器
+    uint64_t m_id;                      //容器内唯一标识
 };
 }
\ No newline at end of file
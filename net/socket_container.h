@@ -1,13 +1,67 @@
 ﻿#pragma once
 
+#include <atomic>
+#include <functional>
+#include <sys/uio.h>
 #include "socket_base.h"
+#include "timing_wheel.h"
+#include "latency_histogram.h"
+#include "../sys/util.h"
 
 namespace deps{
 const uint64_t SOCKET_EVENT_READ = 1;
 const uint64_t SOCKET_EVENT_WRITE = 2;
 const uint64_t SOCKET_EVENT_ERROR = 4;
+//多个容器共享同一个监听描述符时只唤醒其中一个(EPOLLEXCLUSIVE)，只能在AddSocket时指定，不支持的后端忽略
+const uint64_t SOCKET_EVENT_EXCLUSIVE = 8;
+//和SOCKET_EVENT_READ一起指定：由后端直接接收数据，通过HandleRecv送达，不支持的后端忽略(见HasRecvCompletion)
+const uint64_t SOCKET_EVENT_RECV = 16;
+//和SOCKET_EVENT_READ一起指定：监听描述符由后端直接接收新连接，通过HandleAccept送达，只能在AddSocket时指定，不支持的后端忽略
+const uint64_t SOCKET_EVENT_ACCEPT = 32;
+//SubmitSend提交的发送已经完成，只出现在就绪事件里
+const uint64_t SOCKET_EVENT_SEND_DONE = 64;
+
+//容器运行统计，只在事件循环线程里累加，其他线程可以随时读取；两次读取的差值除以间隔就是每秒的速率
+struct ContainerStats{
+    ContainerStats():m_acceptCount(0), m_acceptDropCount(0), m_acceptBatchCount(0),
+        m_udpRecvCalls(0), m_udpRecvCount(0), m_udpSendCalls(0), m_udpSendCount(0),
+        m_relayBytes(0), m_relaySpliceCalls(0),
+        m_budgetBytesHits(0), m_budgetPacketsHits(0), m_budgetTimeHits(0), m_pendingSocketCount(0),
+        m_busyPollCalls(0), m_busyPollHits(0), m_blockingWaits(0), m_loopCpuUs(0),
+        m_socketPoolHits(0), m_socketPoolMisses(0), m_uringEnterCalls(0){}
+    std::atomic<uint64_t> m_acceptCount;        //accept成功的连接数
+    std::atomic<uint64_t> m_acceptDropCount;    //描述符用完时被直接关闭的连接数
+    std::atomic<uint64_t> m_acceptBatchCount;   //监听描述符被唤醒并批量accept的次数
+    std::atomic<uint64_t> m_udpRecvCalls;       //udp接收的系统调用次数
+    std::atomic<uint64_t> m_udpRecvCount;       //udp接收的数据报个数
+    std::atomic<uint64_t> m_udpSendCalls;       //udp发送的系统调用次数
+    std::atomic<uint64_t> m_udpSendCount;       //udp发送的数据报个数
+    std::atomic<uint64_t> m_relayBytes;         //tcp中继转发的字节数
+    std::atomic<uint64_t> m_relaySpliceCalls;   //tcp中继splice的系统调用次数
+    std::atomic<uint64_t> m_budgetBytesHits;    //连接用完字节预算的次数
+    std::atomic<uint64_t> m_budgetPacketsHits;  //连接用完包个数预算的次数
+    std::atomic<uint64_t> m_budgetTimeHits;     //连接用完时间预算的次数
+    std::atomic<uint64_t> m_pendingSocketCount; //预算用完的连接在下一轮不等待事件继续处理的次数
+    std::atomic<uint64_t> m_busyPollCalls;      //忙轮询时不等待的WaitEvents次数
+    std::atomic<uint64_t> m_busyPollHits;       //忙轮询期间等到事件的次数
+    std::atomic<uint64_t> m_blockingWaits;      //阻塞等待事件的次数
+    std::atomic<uint64_t> m_loopCpuUs;          //事件循环线程累计占用的cpu时间(微秒)，每1024轮和阻塞等待前更新
+    LatencyHistogram m_wakeupLatency;           //Post投递任务到事件循环开始执行的延迟(微秒)
+    std::atomic<uint64_t> m_socketPoolHits;     //新连接从回收池里取到对象的次数
+    std::atomic<uint64_t> m_socketPoolMisses;   //回收池为空需要new的次数
+    std::atomic<uint64_t> m_uringEnterCalls;    //io_uring后端io_uring_enter的系统调用次数
+};
+
+//边缘触发模式下单个连接每轮事件循环最多处理的量，任一项用完就放到下一轮继续处理，为0的项不限制
+struct SocketBudget{
+    SocketBudget():m_bytes(0), m_packets(0), m_micros(0){}
+    size_t m_bytes;         //读或者写的字节数
+    size_t m_packets;       //读写的次数(udp是数据报个数)
+    uint64_t m_micros;      //处理时间(微秒)，包括HandlePacket的时间
+};
 
 class SocketBase;
+enum class SocketType;
 
 class SocketContainer
 {
@@ -19,5 +73,67 @@ public:
     virtual bool DelSocket(SocketBase* s)  = 0;
 	virtual void HandleSockets() = 0;
 	virtual int  SocketNum() = 0;
+    //边缘触发模式下，读写接收都需要一直处理到EAGAIN
+    virtual bool IsEdgeTriggered() = 0;
+    //连接用完本次的公平预算后还有数据没处理，下一轮不等待事件直接继续处理
+    virtual void AddPendingSocket(SocketBase* s, uint64_t events) = 0;
+    //本轮事件处理完后回调连接的HandleFlush，用来把本轮攒下的数据一次发出去
+    virtual void AddFlushSocket(SocketBase* s) = 0;
+    //添加或者重设定时器，timeoutMs毫秒后在事件循环里回调
+    virtual void AddTimer(TimerNode* node, uint64_t timeoutMs) = 0;
+    virtual void DelTimer(TimerNode* node) = 0;
+    //以下两个接口可以在任意线程调用：任务放进容器的收件箱并唤醒事件循环，在事件循环线程里执行
+    virtual bool Post(const std::function<void()>& task) = 0;
+    //跨线程发送数据，socketId是SocketBase::GetId()，连接已经关闭时数据被丢弃
+    virtual bool PostPacket(uint64_t socketId, const char* data, size_t size) = 0;
+    virtual ContainerStats& GetStats() = 0;
+    //设置公平预算，之后开始的读写生效
+    virtual void SetBudget(const SocketBudget& budget) = 0;
+    virtual const SocketBudget& GetBudget() = 0;
+    //从回收池里取一个关闭后重置过的type类型连接对象，池里没有时返回nullptr
+    virtual SocketBase* AcquireSocket(SocketType type) = 0;
+    //是否由后端完成接收：带SOCKET_EVENT_RECV的连接不会再收到可读事件，数据由HandleRecv送达
+    virtual bool HasRecvCompletion() = 0;
+    //把发送交给后端，和本轮的其他请求一起提交，完成后回调HandleSendComplete；
+    //iov指向的数据在完成前要保持有效，同一个连接同时只能有一个。后端不支持或者提交不了时返回false，由连接自己发送
+    virtual bool SubmitSend(SocketBase* s, const struct iovec* iov, int iovcnt) = 0;
+};
+
+/**
+ * @brief 按容器的公平预算累计一个连接本轮的处理量，在读写循环里使用：
+ * BudgetTracker budget(m_container);
+ * ... if(budget.Consume(n)){ m_container->AddPendingSocket(this, SOCKET_EVENT_READ); return; }
+ */
+class BudgetTracker{
+public:
+    BudgetTracker(SocketContainer* container):m_container(container), m_budget(container->GetBudget()),
+        m_bytes(0), m_packets(0){
+        m_start = m_budget.m_micros > 0 ? GetMonoTimeUs() : 0;
+    }
+    //记录处理了bytes字节、packets个包，返回true表示预算用完
+    bool Consume(size_t bytes, size_t packets = 1){
+        m_bytes += bytes;
+        m_packets += packets;
+        ContainerStats& stats = m_container->GetStats();
+        if(m_budget.m_bytes > 0 && m_bytes >= m_budget.m_bytes){
+            stats.m_budgetBytesHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if(m_budget.m_packets > 0 && m_packets >= m_budget.m_packets){
+            stats.m_budgetPacketsHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if(m_budget.m_micros > 0 && GetMonoTimeUs() - m_start >= m_budget.m_micros){
+            stats.m_budgetTimeHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+private:
+    SocketContainer* m_container;
+    const SocketBudget& m_budget;
+    size_t m_bytes;
+    size_t m_packets;
+    uint64_t m_start;
 };
 }
\ No newline at end of file
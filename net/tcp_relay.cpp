@@ -0,0 +1,322 @@
+#include "tcp_relay.h"
+#include "tcp_socket.h"
+#ifndef __APPLE__
+#include <fcntl.h>
+#endif
+
+using namespace deps;
+
+//splice只有linux支持
+static ssize_t SpliceData(int in, int out, size_t size){
+#ifdef __APPLE__
+    errno = ENOSYS;
+    return -1;
+#else
+    return splice(in, NULL, out, NULL, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+}
+
+TcpRelay* TcpRelay::Create(TcpSocket* a, TcpSocket* b){
+    if(nullptr == a || nullptr == b || a == b){
+        LOG_ERROR("relay socket a:%p b:%p invalid", a, b);
+        return nullptr;
+    }
+    TcpRelay* relay = new TcpRelay();
+    if(!relay->Init(a, b)){
+        delete relay;
+        return nullptr;
+    }
+    LOG_DEBUG("relay:%p start tcp fd:%d socket:%p <-> tcp fd:%d socket:%p pipe size:%zu",
+        relay, a->m_fd, a, b->m_fd, b, relay->m_pipeSize);
+    if(!relay->UpdateEvents()){
+        return nullptr;
+    }
+    //可能是在HandlePacket里调用的，接收缓冲区还在使用，等本轮处理完再转发剩下的数据；
+    //已经可读的数据在边缘触发模式下也不会再有事件
+    a->m_container->AddPendingSocket(a, SOCKET_EVENT_READ);
+    b->m_container->AddPendingSocket(b, SOCKET_EVENT_READ);
+    return relay;
+}
+
+TcpRelay::TcpRelay(){
+    for(int i = 0; i < 2; ++i){
+        m_sockets[i] = nullptr;
+        m_dirs[i].m_pipe[0] = -1;
+        m_dirs[i].m_pipe[1] = -1;
+        m_dirs[i].m_pipeBytes = 0;
+        m_dirs[i].m_eof = false;
+        m_dirs[i].m_blocked = false;
+        m_dirs[i].m_shutdown = false;
+        m_events[i] = 0;
+    }
+    m_pipeSize = 0;
+}
+
+TcpRelay::~TcpRelay(){
+    for(int i = 0; i < 2; ++i){
+        if(nullptr != m_sockets[i]){
+            m_sockets[i]->m_relay = nullptr;
+            m_sockets[i] = nullptr;
+        }
+        for(int j = 0; j < 2; ++j){
+            if(-1 != m_dirs[i].m_pipe[j]){
+                close(m_dirs[i].m_pipe[j]);
+                m_dirs[i].m_pipe[j] = -1;
+            }
+        }
+    }
+}
+
+bool TcpRelay::Init(TcpSocket* a, TcpSocket* b){
+#ifdef __APPLE__
+    LOG_ERROR("relay not supported");
+    return false;
+#else
+    TcpSocket* s[2] = {a, b};
+    for(int i = 0; i < 2; ++i){
+        SocketState st = s[i]->m_state;
+        if(SocketState::accept != st && SocketState::connected != st && SocketState::connecting != st){
+            LOG_ERROR("tcp fd:%d socket:%p state:%s can't relay", s[i]->m_fd, s[i], SocketBase::toString(st).c_str());
+            return false;
+        }
+        if(nullptr != s[i]->m_relay){
+            LOG_ERROR("tcp fd:%d socket:%p already in relay", s[i]->m_fd, s[i]);
+            return false;
+        }
+        int fileFd = -1;
+        off_t offset = 0;
+        size_t size = 0, total = 0;
+        SendQueue* output = s[i]->m_output;
+        if(nullptr != output && (output->FrontFile(&fileFd, &offset, &size, &total) || output->ZeroCopyPending() > 0)){
+            LOG_ERROR("tcp fd:%d socket:%p has file or zero copy data pending, can't relay", s[i]->m_fd, s[i]);
+            return false;
+        }
+    }
+    if(a->m_container != b->m_container){
+        LOG_ERROR("tcp socket:%p socket:%p not in the same container", a, b);
+        return false;
+    }
+    //后端直接接收时数据不经过描述符的可读事件，不能用splice转发
+    if(a->m_container->HasRecvCompletion()){
+        LOG_ERROR("tcp socket:%p socket:%p container receives by completion, can't relay", a, b);
+        return false;
+    }
+    m_pipeSize = TCP_RELAY_PIPE_SIZE;
+    for(int d = 0; d < 2; ++d){
+        if(-1 == pipe2(m_dirs[d].m_pipe, O_NONBLOCK | O_CLOEXEC)){
+            LOG_ERROR("relay create pipe failed %s", strerror(errno));
+            return false;
+        }
+        //扩大管道失败(超过pipe-max-size)时使用默认大小
+        fcntl(m_dirs[d].m_pipe[1], F_SETPIPE_SZ, TCP_RELAY_PIPE_SIZE);
+        int size = fcntl(m_dirs[d].m_pipe[1], F_GETPIPE_SZ);
+        if(size > 0 && (size_t)size < m_pipeSize){
+            m_pipeSize = size;
+        }
+    }
+    for(int i = 0; i < 2; ++i){
+        m_sockets[i] = s[i];
+        s[i]->m_relay = this;
+        s[i]->m_isResending = false;
+        //关注的事件全部由中继重新设置
+        m_events[i] = SOCKET_EVENT_READ | SOCKET_EVENT_WRITE | SOCKET_EVENT_ERROR;
+    }
+    return true;
+#endif
+}
+
+void TcpRelay::HandleRead(TcpSocket* s){
+    int d = Index(s);
+    //接收缓冲区里还没处理的数据放到对端的发送队列，Flush时先于管道里的数据发出去
+    if(nullptr != s->m_input && !s->m_input->empty()){
+        TcpSocket* dst = m_sockets[1-d];
+        if(!dst->Output()->Append(s->m_input->data(), s->m_input->size())){
+            LOG_ERROR("tcp fd:%d socket:%p output full, can't relay", dst->m_fd, dst);
+            dst->Close();
+            return;
+        }
+        s->m_input->erase();
+    }
+    if(Pump(d)){
+        UpdateEvents();
+    }
+}
+
+void TcpRelay::HandleWrite(TcpSocket* s){
+    int d = 1 - Index(s);
+    m_dirs[d].m_blocked = false;
+    if(Pump(d)){
+        UpdateEvents();
+    }
+}
+
+void TcpRelay::HandleClose(TcpSocket* s){
+    int i = Index(s);
+    TcpSocket* peer = m_sockets[1-i];
+    LOG_DEBUG("relay:%p tcp fd:%d socket:%p closed, bytes:%llu/%llu splice:%llu", this, s->m_fd, s,
+        (unsigned long long)m_stats.m_bytes[0], (unsigned long long)m_stats.m_bytes[1],
+        (unsigned long long)m_stats.m_spliceCalls);
+    //先解除绑定再关闭对端，对端Close时不会再回调到中继
+    delete this;
+    if(nullptr != peer){
+        peer->Close();
+    }
+}
+
+ssize_t TcpRelay::Flush(int d){
+    TcpSocket* dst = m_sockets[1-d];
+    Direction& dir = m_dirs[d];
+    ssize_t sent = 0;
+    //接管前发送队列里剩下的数据要先发出去，保证顺序
+    while(0 != dst->GetOutputSize()){
+        struct iovec iov[IOV_MAX];
+        int iovcnt = dst->m_output->GetIov(iov, IOV_MAX);
+        ssize_t n = writev(dst->m_fd, iov, iovcnt);
+        if(-1 == n){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                dir.m_blocked = true;
+                return sent;
+            }
+            LOG_ERROR("tcp fd:%d socket:%p %s", dst->m_fd, dst, strerror(errno));
+            return -1;
+        }
+        dst->m_output->Consume(n);
+        sent += n;
+    }
+    while(dir.m_pipeBytes > 0){
+        ssize_t n = SpliceData(dir.m_pipe[0], dst->m_fd, dir.m_pipeBytes);
+        m_stats.m_spliceCalls++;
+        if(-1 == n){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                dir.m_blocked = true;
+                return sent;
+            }
+            LOG_ERROR("tcp fd:%d socket:%p splice %s", dst->m_fd, dst, strerror(errno));
+            return -1;
+        }
+        dir.m_pipeBytes -= n;
+        m_stats.m_bytes[d] += n;
+        sent += n;
+    }
+    return sent;
+}
+
+bool TcpRelay::Pump(int d){
+    TcpSocket* src = m_sockets[d];
+    TcpSocket* dst = m_sockets[1-d];
+    Direction& dir = m_dirs[d];
+    ContainerStats& stats = src->m_container->GetStats();
+    //和TcpSocket::Read一样，每轮转发不超过容器的公平预算，防止饿死其他连接
+    BudgetTracker budget(src->m_container);
+    bool exhausted = false;
+    uint64_t spliceCalls = m_stats.m_spliceCalls;
+    uint64_t bytes = m_stats.m_bytes[d];
+    //连接中的一端还不能读写
+    bool canRead = SocketState::connecting != src->m_state;
+    if(SocketState::connecting == dst->m_state){
+        dir.m_blocked = true;
+    }
+    while(true){
+        bool progress = false;
+        if(!dir.m_blocked){
+            ssize_t n = Flush(d);
+            if(-1 == n){
+                dst->Close();
+                return false;
+            }
+            progress = n > 0;
+        }
+        if(canRead && !dir.m_eof && !exhausted && dir.m_pipeBytes < m_pipeSize){
+            ssize_t n = SpliceData(src->m_fd, dir.m_pipe[1], m_pipeSize - dir.m_pipeBytes);
+            m_stats.m_spliceCalls++;
+            if(-1 == n){
+                if(errno == EINTR){
+                    continue;
+                }
+                if(errno != EAGAIN && errno != EWOULDBLOCK){
+                    LOG_ERROR("tcp fd:%d socket:%p splice %s", src->m_fd, src, strerror(errno));
+                    src->Close();
+                    return false;
+                }
+            }
+            else if(0 == n){
+                LOG_DEBUG("tcp fd:%d socket:%p relay read eof", src->m_fd, src);
+                dir.m_eof = true;
+                progress = true;
+            }
+            else{
+                dir.m_pipeBytes += n;
+                exhausted = budget.Consume(n);
+                progress = true;
+                if(dir.m_blocked && dir.m_pipeBytes >= m_pipeSize){
+                    m_stats.m_pipeFullCount++;
+                }
+            }
+        }
+        if(!progress){
+            break;
+        }
+    }
+    stats.m_relaySpliceCalls.fetch_add(m_stats.m_spliceCalls - spliceCalls, std::memory_order_relaxed);
+    if(m_stats.m_bytes[d] != bytes){
+        stats.m_relayBytes.fetch_add(m_stats.m_bytes[d] - bytes, std::memory_order_relaxed);
+        time_t now = time(NULL);
+        src->SetLastAccessTime(now);
+        dst->SetLastAccessTime(now);
+    }
+    //预算用完了源连接可能还有数据，边缘触发模式下不会再有可读事件
+    if(exhausted && src->m_container->IsEdgeTriggered()){
+        src->m_container->AddPendingSocket(src, SOCKET_EVENT_READ);
+    }
+    //源连接读完并且数据都发出去之后，把EOF传给对端
+    if(dir.m_eof && !dir.m_shutdown && 0 == dir.m_pipeBytes && 0 == dst->GetOutputSize()){
+        dir.m_shutdown = true;
+        if(-1 == shutdown(dst->m_fd, SHUT_WR)){
+            LOG_ERROR("tcp fd:%d socket:%p shutdown %s", dst->m_fd, dst, strerror(errno));
+            dst->Close();
+            return false;
+        }
+        if(m_dirs[1-d].m_shutdown){
+            LOG_DEBUG("relay:%p finished", this);
+            src->Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TcpRelay::UpdateEvents(){
+    for(int i = 0; i < 2; ++i){
+        TcpSocket* s = m_sockets[i];
+        const Direction& out = m_dirs[i];     //s是源连接的方向
+        const Direction& in = m_dirs[1-i];    //s是对端连接的方向
+        uint64_t events = SOCKET_EVENT_ERROR;
+        if(SocketState::connecting == s->m_state){
+            events |= SOCKET_EVENT_WRITE;
+        }
+        else{
+            if(!out.m_eof && out.m_pipeBytes < m_pipeSize){
+                events |= SOCKET_EVENT_READ;
+            }
+            if(in.m_blocked){
+                events |= SOCKET_EVENT_WRITE;
+            }
+        }
+        if(events == m_events[i]){
+            continue;
+        }
+        if(!s->m_container->ModSocket(s, events)){
+            LOG_ERROR("tcp fd:%d socket:%p mod events failed", s->m_fd, s);
+            s->Close();
+            return false;
+        }
+        m_events[i] = events;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace deps{
+class TcpSocket;
+
+//中继的统计，只在事件循环线程里累加
+struct TcpRelayStats{
+    TcpRelayStats():m_spliceCalls(0), m_pipeFullCount(0){
+        m_bytes[0] = 0;
+        m_bytes[1] = 0;
+    }
+    uint64_t m_bytes[2];            //m_bytes[0]是第一个连接发往第二个连接的字节数，m_bytes[1]相反
+    uint64_t m_spliceCalls;         //splice的系统调用次数
+    uint64_t m_pipeFullCount;       //对端发不出去、管道满了暂停读取的次数
+};
+
+/**
+ * @brief TCP中继：把同一个容器里的两个连接绑在一起，一个连接收到的数据原样转发给另一个连接。
+ * 每个方向一个管道，用splice从连接读到管道、再从管道写到对端连接，数据不经过用户态。
+ * 对端发不出去时数据留在管道里，管道满了就不再关注源连接的可读事件，把压力传回源连接。
+ * 一个方向读到EOF并且管道里的数据发完后，对端连接shutdown(SHUT_WR)，两个方向都结束后关闭两个连接；
+ * 任一连接出错、超时或者被关闭时另一个连接也会被关闭，中继随之释放。
+ * 只有linux支持。
+ */
+class TcpRelay{
+public:
+    /**
+     * @brief 开始中继，两个连接都必须在同一个容器里，状态是accept、connected或者connecting，
+     * connecting的连接连上之后才开始转发。可以在HandlePacket里调用，之后的数据不再交给PacketHandler，
+     * 接收缓冲区里还没处理的数据(HandlePacket没有处理的部分)会先转发给对端，
+     * 发送队列里已有的数据先发出去，不支持还没发完的SendFile和零拷贝发送，也不支持完成式收发的容器(io_uring后端)。
+     * 返回的中继在任一连接关闭前有效。参数不满足条件时返回nullptr，连接不受影响；
+     * 开始转发时就出错也返回nullptr，这时两个连接都已经关闭。
+     */
+    static TcpRelay* Create(TcpSocket* a, TcpSocket* b);
+    TcpRelay(const TcpRelay&)=delete;
+    TcpRelay& operator=(const TcpRelay&)=delete;
+
+    const TcpRelayStats& GetStats(){return m_stats;}
+    size_t GetPipeSize(){return m_pipeSize;}
+private:
+    friend class TcpSocket;
+    TcpRelay();
+    ~TcpRelay();
+    bool Init(TcpSocket* a, TcpSocket* b);
+    //连接可读、可写时由TcpSocket调用，可读时先把接收缓冲区里剩下的数据放到对端的发送队列
+    void HandleRead(TcpSocket* s);
+    void HandleWrite(TcpSocket* s);
+    //连接关闭时由TcpSocket调用，关闭另一个连接并释放中继
+    void HandleClose(TcpSocket* s);
+    int Index(TcpSocket* s){return s == m_sockets[0] ? 0 : 1;}
+    //转发方向d的数据(d=0是第一个连接到第二个连接)，返回false表示中继已经关闭
+    bool Pump(int d);
+    //把对端连接发送队列和管道里的数据发出去，返回发送的字节数，-1表示出错
+    ssize_t Flush(int d);
+    //根据两个方向的状态重新设置连接关注的事件，返回false表示中继已经关闭
+    bool UpdateEvents();
+private:
+    struct Direction{
+        int m_pipe[2];
+        size_t m_pipeBytes;         //管道里待发送的字节数
+        bool m_eof;                 //源连接已经读到EOF
+        bool m_blocked;             //对端连接发送返回了EAGAIN，等可写事件
+        bool m_shutdown;            //已经关闭对端连接的写方向
+    };
+    TcpSocket* m_sockets[2];
+    Direction m_dirs[2];
+    uint64_t m_events[2];           //两个连接当前关注的事件
+    size_t m_pipeSize;              //管道容量
+    TcpRelayStats m_stats;
+};
+}
@@ -1,18 +1,70 @@
 #include "tcp_socket.h"
+#include "packet.h"
+#ifndef __APPLE__
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#endif
 
 using namespace deps;
 
 TcpSocket::TcpSocket(SocketContainer *pContainer, PacketHandler* handler){
     m_container = pContainer;
     m_handler = handler;
+    m_input = nullptr;
+    m_output = nullptr;
+    Reset();
+}
+
+TcpSocket* TcpSocket::Create(SocketContainer *pContainer, PacketHandler* handler){
+    TcpSocket* s = (TcpSocket*)pContainer->AcquireSocket(SocketType::tcp);
+    if(nullptr == s){
+        return new TcpSocket(pContainer, handler);
+    }
+    s->m_handler = handler;
+    return s;
+}
+
+bool TcpSocket::Recycle(){
+    //派生类的对象不能当作TcpSocket复用
+    if(typeid(*this) != typeid(TcpSocket)){
+        return false;
+    }
+    //缓冲区对象留着复用
+    if(nullptr != m_input){
+        m_input->erase();
+    }
+    if(nullptr != m_output){
+        m_output->Clear();
+    }
+    m_handler = nullptr;
+    Reset();
+    return true;
+}
+
+void TcpSocket::Reset(){
     m_fd = -1;
     m_state = SocketState::close;
 	m_type = SocketType::tcp;
     m_createTime = 0;
     m_lastAccessTime = 0;
     m_timeout = 0;
-    m_input = new BlockBuffer<def_block_alloc_4k, 1024>;
-    m_output = new BlockBuffer<def_block_alloc_4k, 1024>;
+    m_id = 0;
+    bzero(&m_peerAddr, sizeof(m_peerAddr));
+    m_isResending = false;
+    m_reserveFd = -1;
+    m_zeroCopyThreshold = 0;
+    m_zeroCopyNextId = 0;
+    m_zeroCopyBytes = 0;
+    m_zeroCopyCopiedBytes = 0;
+    m_relay = nullptr;
+    m_highWaterMark = 0;
+    m_lowWaterMark = 0;
+    m_pauseReadOnHighWater = false;
+    m_aboveHighWater = false;
+    m_readPaused = false;
+    m_sendInFlight = false;
+    m_recvStashed = false;
+    m_sendStats = TcpSendStats();
 }
 
 TcpSocket::~TcpSocket(){
@@ -30,6 +82,37 @@ TcpSocket::~TcpSocket(){
     m_output = nullptr;
 }
 
+RingBuffer<def_block_alloc_4k, 1024>* TcpSocket::Input(){
+    if(nullptr == m_input){
+        m_input = new RingBuffer<def_block_alloc_4k, 1024>;
+        m_input->set_role(BUFFER_ROLE_SOCKET_INPUT);
+    }
+    return m_input;
+}
+
+SendQueue* TcpSocket::Output(){
+    if(nullptr == m_output){
+        m_output = new SendQueue(TCP_OUTPUT_MAX_SIZE);
+    }
+    return m_output;
+}
+
+void TcpSocket::ReleaseIdleBuffers(){
+    //中继直接使用两个连接的缓冲区
+    if(nullptr == m_handler || m_relay || !m_handler->ReleaseIdleBuffers()){
+        return;
+    }
+    if(nullptr != m_input && m_input->empty()){
+        delete m_input;
+        m_input = nullptr;
+    }
+    //零拷贝发送的数据段要等完成通知才能释放
+    if(nullptr != m_output && m_output->Empty() && 0 == m_output->ZeroCopyPending()){
+        delete m_output;
+        m_output = nullptr;
+    }
+}
+
 bool TcpSocket::EnableTcpKeepAlive(int aliveTime, int interval, int count){
     int keepalive = 1;
     if(-1 == setsockopt(m_fd, SOL_SOCKET, SO_KEEPALIVE, (void*)&keepalive, sizeof(keepalive))){
@@ -70,6 +153,83 @@ bool TcpSocket::EnableTcpKeepAlive(int aliveTime, int interval, int count){
     return true;
 }
 
+bool TcpSocket::EnableZeroCopy(size_t threshold){
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    int on = 1;
+    if(-1 == setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on))){
+        LOG_ERROR("tcp fd:%d socket:%p SO_ZEROCOPY %s", m_fd, this, strerror(errno));
+        return false;
+    }
+    m_zeroCopyThreshold = threshold > 0 ? threshold : 1;
+    return true;
+#else
+    LOG_ERROR("tcp fd:%d socket:%p SO_ZEROCOPY not supported", m_fd, this);
+    return false;
+#endif
+}
+
+bool TcpSocket::ReadZeroCopyCompletions(){
+    bool found = false;
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    while(true){
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + CMSG_SPACE(sizeof(struct sockaddr_in))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(-1 == recvmsg(m_fd, &msg, MSG_ERRQUEUE)){
+            if(errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); nullptr != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+            if(!((SOL_IP == cmsg->cmsg_level && IP_RECVERR == cmsg->cmsg_type)
+                || (SOL_IPV6 == cmsg->cmsg_level && IPV6_RECVERR == cmsg->cmsg_type))){
+                continue;
+            }
+            struct sock_extended_err* err = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if(SO_EE_ORIGIN_ZEROCOPY != err->ee_origin){
+                continue;
+            }
+            //ee_info到ee_data这一段序号的发送都完成了
+            found = true;
+            size_t bytes = nullptr == m_output ? 0 : m_output->CompleteZeroCopy(err->ee_data);
+            if(err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED){
+                m_zeroCopyCopiedBytes += bytes;
+            }
+            else{
+                m_zeroCopyBytes += bytes;
+            }
+            LOG_DEBUG("tcp fd:%d socket:%p zerocopy done id:%u-%u bytes:%zu code:%u", m_fd, this, 
+                err->ee_info, err->ee_data, bytes, (unsigned)err->ee_code);
+        }
+    }
+#endif
+    return found;
+}
+
+ssize_t TcpSocket::SendZeroCopy(struct iovec* iov, bool* zeroCopy){
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 1;
+#ifdef MSG_ZEROCOPY
+    ssize_t n = sendmsg(m_fd, &msg, MSG_ZEROCOPY);
+    if(n != -1 || errno != ENOBUFS){
+        return n;
+    }
+    //锁定的内存超过限制，这次退回普通发送
+    LOG_DEBUG("tcp fd:%d socket:%p zerocopy %s, fallback", m_fd, this, strerror(errno));
+#endif
+    *zeroCopy = false;
+    ssize_t ret = sendmsg(m_fd, &msg, 0);
+    if(ret > 0){
+        m_zeroCopyCopiedBytes += ret;
+    }
+    return ret;
+}
+
 bool TcpSocket::EnableTcpNoDelay(){
     int nodelay = 1; 
     if(-1 == setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, (void*)&nodelay, sizeof(nodelay))){
@@ -83,8 +243,12 @@ void TcpSocket::HandleRead(char* max_read_buffer, size_t max_read_size){
     if (m_state == SocketState::listen) {
         Accept();
     }
+    else if (m_relay && (m_state == SocketState::accept || m_state == SocketState::connecting|| m_state == SocketState::connected)) {
+        m_relay->HandleRead(this);
+    }
     else if (m_state == SocketState::accept || m_state == SocketState::connecting|| m_state == SocketState::connected) {
         Read(max_read_buffer, max_read_size);
+        ReleaseIdleBuffers();
     }
     else{
         LOG_INFO("tcp fd:%d socket:%p state:%s can't read", m_fd, this, toString(m_state).c_str());
@@ -96,16 +260,27 @@ void TcpSocket::HandleWrite()
     if (m_state == SocketState::connecting){
         LOG_INFO("tcp fd:%d socket:%p from connecting to connected", m_fd, this);
         m_state = SocketState::connected;
-		m_timeout = 0;
+		SetTimeout(0);
+		if(m_relay){
+			m_relay->HandleWrite(this);
+			return;
+		}
 		//connected以后只需要关注可读事件
-		if(!m_container->ModSocket(this, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+		if(!UpdateEvents()){
 			LOG_ERROR("tcp fd:%d socket:%p mod events failed", m_fd, this);
 			Close();
 			return;
 		}
+		//连接建立之前排队的数据
+		Write();
+		ReleaseIdleBuffers();
+    }
+    else if (m_relay && (m_state == SocketState::accept || m_state == SocketState::connected)) {
+        m_relay->HandleWrite(this);
     }
     else if (m_state == SocketState::accept || m_state == SocketState::connected) {
         Write();
+        ReleaseIdleBuffers();
     }
     else{
         LOG_INFO("tcp fd:%d socket:%p state:%s can't write", m_fd, this, toString(m_state).c_str());
@@ -114,6 +289,16 @@ void TcpSocket::HandleWrite()
 
 void TcpSocket::HandleError()
 {
+    //零拷贝完成通知也是通过错误事件送达的，读完通知后socket本身没有错误就继续使用；
+    //通知可能已经在上一次错误事件里读完了(multishot poll每次唤醒都会通知)，所以读没读到都要检查
+    if(m_zeroCopyThreshold > 0){
+        ReadZeroCopyCompletions();
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if(0 == getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len) && 0 == err){
+            return;
+        }
+    }
     LOG_ERROR("tcp fd:%d socket:%p state:%s error", m_fd, this, toString(m_state).c_str());
     Close();
 }
@@ -130,23 +315,54 @@ void TcpSocket::HandleTimeout()
     }
 }
 
-bool TcpSocket::Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler) {
+bool TcpSocket::Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler, bool reusePort) {
+    int fd = CreateListenFd(port, backlog, reusePort);
+    if(fd == -1){
+        return false;
+    }
+    return ListenFd(fd, port, pContainer, handler, false);
+}
+
+int TcpSocket::CreateListenFd(int port, int backlog, bool reusePort) {
+#ifdef __APPLE__
 	int fd = socket(AF_INET, SOCK_STREAM, 0);
+#else
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#endif
 	if (fd == -1) {
         LOG_ERROR("tcp %s", strerror(errno));
-		return false;
+		return -1;
 	}
 
+#ifdef __APPLE__
 	int flags = fcntl(fd, F_GETFL, 0);
-	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
 		LOG_ERROR("tcp fd:%d %s", fd, strerror(errno));
-        return false;
+        close(fd);
+        return -1;
 	}
+#endif
 
     int reuse = 1;
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int)) == -1) {
 		LOG_ERROR("tcp fd:%d %s", fd, strerror(errno));
-        return false;
+        close(fd);
+        return -1;
+	}
+
+    //多个描述符监听同一个端口，由内核把新连接分散到各个描述符
+    if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(int)) == -1) {
+		LOG_ERROR("tcp fd:%d %s", fd, strerror(errno));
+        close(fd);
+        return -1;
+	}
+
+    //linux下accept出来的连接会继承监听描述符的TCP_NODELAY，不用每个连接再设置一次
+    int nodelay = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int)) == -1) {
+		LOG_ERROR("tcp fd:%d %s", fd, strerror(errno));
+        close(fd);
+        return -1;
 	}
 
 	struct sockaddr_in addr;
@@ -156,22 +372,36 @@ bool TcpSocket::Listen(int port, int backlog, SocketContainer *pContainer, Packe
 	addr.sin_addr.s_addr = htonl(INADDR_ANY);
 	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
 		LOG_ERROR("tcp fd:%d %s", fd, strerror(errno));
-        return false;
+        close(fd);
+        return -1;
 	}
 
     if(listen(fd, backlog) == -1){
         LOG_ERROR("tcp fd:%d %s",fd, strerror(errno));
-        return false;
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    TcpSocket *s = new TcpSocket(pContainer, handler);
+bool TcpSocket::ListenFd(int fd, int port, SocketContainer *pContainer, PacketHandler* handler, bool exclusive) {
+    TcpSocket *s = TcpSocket::Create(pContainer, handler);
     s->SetFd(fd);
     s->SetCreateTime(time(NULL));
     s->SetLastAccessTime(s->GetCreateTime());
     s->SetState(SocketState::listen);
+    //预留一个描述符，进程描述符用完时释放它来接收并关闭新连接
+    s->m_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if(s->m_reserveFd == -1){
+        LOG_ERROR("tcp fd:%d socket:%p open reserve fd failed %s", fd, s, strerror(errno));
+    }
 	LOG_DEBUG("tcp fd:%d socket:%p new socket", s->GetFd(), s);
-	//listenfd只需要关注可读事件
-    if(!pContainer->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+	//listenfd只需要关注可读事件，后端支持时由后端直接接收新连接
+    uint64_t events = SOCKET_EVENT_READ|SOCKET_EVENT_ACCEPT|SOCKET_EVENT_ERROR;
+    if(exclusive){
+        events |= SOCKET_EVENT_EXCLUSIVE;
+    }
+    if(!pContainer->AddSocket(s, events)){
         LOG_ERROR("tcp fd:%d socket:%p add events failed", fd, s);
         s->Close();
         return false;
@@ -201,14 +431,14 @@ SocketBase* TcpSocket::Connect(uint32_t ip, int port, SocketContainer *pContaine
     peerAddr.sin_addr.s_addr=ip;
     int ret = connect(fd,(struct sockaddr *)(&peerAddr),sizeof(struct sockaddr));
     LOG_DEBUG("tcp fd:%d start connecting %s:%u",fd, UintIP2String(ip).c_str(), port);
-    TcpSocket *s = new TcpSocket(pContainer, handler);
+    TcpSocket *s = TcpSocket::Create(pContainer, handler);
     s->SetFd(fd);
     s->SetCreateTime(time(NULL));
     s->SetLastAccessTime(s->GetCreateTime());
     s->SetPeerAddr(peerAddr);
 	LOG_DEBUG("tcp fd:%d socket:%p new socket %s:%u", s->GetFd(), s, UintIP2String(ip).c_str(), port);
 	//connected fd只需要关注可读事件
-    if(ret == 0 && pContainer->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+    if(ret == 0 && pContainer->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_RECV|SOCKET_EVENT_ERROR)){
         s->SetState(SocketState::connected);
         LOG_DEBUG("tcp fd:%d socket:%p connected %s:%u",s->GetFd(), s, UintIP2String(ip).c_str(), port);
         return s;
@@ -228,109 +458,456 @@ SocketBase* TcpSocket::Connect(uint32_t ip, int port, SocketContainer *pContaine
 
 
 void TcpSocket::Accept() {
-	struct sockaddr_in addr;
-	bzero(&addr, sizeof(addr));
-	int addrLen = sizeof(addr);
-	int afd = accept(m_fd, (struct sockaddr*)(&addr),(socklen_t*)&addrLen);
-	if (-1 == afd) {
-        LOG_ERROR("tcp listenfd:%d %s", m_fd, strerror(errno));
-		Close();
-        return;
-	}
+    //每次唤醒最多接收ACCEPT_BATCH_SIZE个连接，防止连接风暴时饿死其他连接
+    ContainerStats& stats = m_container->GetStats();
+    stats.m_acceptBatchCount.fetch_add(1, std::memory_order_relaxed);
+    for(int i = 0; i < ACCEPT_BATCH_SIZE; ++i){
+        struct sockaddr_in addr;
+        bzero(&addr, sizeof(addr));
+        socklen_t addrLen = sizeof(addr);
+#ifdef __APPLE__
+        int afd = accept(m_fd, (struct sockaddr*)(&addr), &addrLen);
+#else
+        int afd = accept4(m_fd, (struct sockaddr*)(&addr), &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#endif
+        if (-1 == afd) {
+            if(errno == EINTR || errno == ECONNABORTED || errno == EPROTO){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                return;
+            }
+            if(errno == EMFILE || errno == ENFILE){
+                LOG_ERROR("tcp listenfd:%d %s", m_fd, strerror(errno));
+                if(DropPendingConnection()){
+                    stats.m_acceptDropCount.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                return;
+            }
+            if(errno == ENOBUFS || errno == ENOMEM){
+                //内存暂时不够，连接留在backlog里下次再接收
+                LOG_ERROR("tcp listenfd:%d %s", m_fd, strerror(errno));
+                return;
+            }
+            LOG_ERROR("tcp listenfd:%d %s", m_fd, strerror(errno));
+            Close();
+            return;
+        }
 
-	int flags = fcntl(afd, F_GETFL, 0);
-	if (fcntl(afd, F_SETFL, flags | O_NONBLOCK) == -1) {
-		LOG_ERROR("tcp listenfd:%d fd:%d %s",m_fd, afd, strerror(errno));
-        Close();
-        return;
-	}
+#ifdef __APPLE__
+        int flags = fcntl(afd, F_GETFL, 0);
+        if (fcntl(afd, F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(afd, F_SETFD, FD_CLOEXEC) == -1) {
+            LOG_ERROR("tcp listenfd:%d fd:%d %s",m_fd, afd, strerror(errno));
+            close(afd);
+            continue;
+        }
+#endif
+        stats.m_acceptCount.fetch_add(1, std::memory_order_relaxed);
+        AddAccepted(afd, &addr);
+    }
+
+    if(m_container->IsEdgeTriggered()){
+        //边缘触发模式下批次用完还没到EAGAIN，下一轮继续；水平触发模式下事件会再次触发
+        m_container->AddPendingSocket(this, SOCKET_EVENT_READ);
+    }
+}
 
-	TcpSocket *s = new TcpSocket(m_container, m_handler);
+void TcpSocket::AddAccepted(int afd, const struct sockaddr_in* addr){
+    TcpSocket *s = TcpSocket::Create(m_container, m_handler);
     s->SetFd(afd);
-	s->SetPeerAddr(addr);
+    if(nullptr != addr){
+        s->SetPeerAddr(*addr);
+    }
     s->SetCreateTime(time(NULL));
-	s->SetLastAccessTime(s->GetCreateTime());
-	s->SetTimeout(TCP_ACCESS_TIMEOUT);
-	s->SetState(SocketState::accept);
-	LOG_DEBUG("tcp listenfd:%d fd:%d socket:%p new socket", m_fd, afd, s);
-	//只需要关注可读事件
-    if(!m_container->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+    s->SetLastAccessTime(s->GetCreateTime());
+    s->SetTimeout(TCP_ACCESS_TIMEOUT);
+    s->SetState(SocketState::accept);
+    LOG_DEBUG("tcp listenfd:%d fd:%d socket:%p new socket", m_fd, afd, s);
+    //只需要关注可读事件
+    if(!m_container->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_RECV|SOCKET_EVENT_ERROR)){
         LOG_ERROR("tcp listenfd:%d fd:%d socket:%p add events failed", m_fd, afd, s);
         s->Close();
         return;
     }
 
+#ifdef __APPLE__
     if(!s->EnableTcpNoDelay()){
         LOG_ERROR("tcp listenfd:%d fd:%d socket:%p set tcp no delay failed", m_fd, afd, s);
         s->Close();
         return;
     }
+#endif
 
     LOG_INFO("tcp listenfd:%d fd:%d socket:%p accept", m_fd, afd, s);
 }
 
+void TcpSocket::HandleAccept(int fd){
+    if(m_state != SocketState::listen){
+        close(fd);
+        return;
+    }
+    //后端接收的连接不带对端地址
+    m_container->GetStats().m_acceptCount.fetch_add(1, std::memory_order_relaxed);
+    AddAccepted(fd, nullptr);
+}
+
+void TcpSocket::HandleRecv(const char* data, int result){
+    if (m_state != SocketState::accept && m_state != SocketState::connecting && m_state != SocketState::connected) {
+        LOG_INFO("tcp fd:%d socket:%p state:%s can't read", m_fd, this, toString(m_state).c_str());
+        return;
+    }
+    if(result < 0){
+        LOG_ERROR("tcp fd:%d socket:%p %s", m_fd, this, strerror(-result));
+        Close();
+        return;
+    }
+    if(0 == result){
+        struct sockaddr_in addr = GetPeerAddr();
+        LOG_INFO("tcp fd:%d socket:%p peer close %s:%u", m_fd, this, 
+            inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+        Close();
+        return;
+    }
+    SetLastAccessTime(time(NULL));
+    //暂停读取之前内核已经收下的数据仍然会送达，先按顺序存进接收缓冲区，恢复读取后再处理
+    if(m_readPaused || m_recvStashed){
+        if(!Input()->append(data, result)){
+            LOG_ERROR("tcp fd:%d socket:%p input overflow size:%zu", m_fd, this, m_input->size());
+            Close();
+            return;
+        }
+        m_recvStashed = true;
+        return;
+    }
+    if(!Unpack(data, result)){
+        return;
+    }
+    ReleaseIdleBuffers();
+}
+
+void TcpSocket::UnpackStashed(){
+    if(!m_recvStashed){
+        return;
+    }
+    m_recvStashed = false;
+    //接收缓冲区里可能还有不完整的包，整段取出来重新分包
+    std::vector<char> data(m_input->data(), m_input->data() + m_input->size());
+    m_input->erase();
+    Unpack(data.data(), data.size());
+}
+
+void TcpSocket::HandleSendComplete(int result){
+    m_sendInFlight = false;
+    if(-1 == m_fd){
+        return;
+    }
+    if(result < 0){
+        LOG_ERROR("tcp fd:%d socket:%p %s", m_fd, this, strerror(-result));
+        Close();
+        return;
+    }
+    m_output->Consume(result);
+    m_sendStats.m_sentBytes += result;
+    CheckLowWaterMark();
+    if(-1 == m_fd){
+        return;
+    }
+    //之前自己发送时遇到过EAGAIN，发完了就不再关注可写事件
+    if(m_output->Empty() && m_isResending){
+        m_isResending = false;
+        if(!UpdateEvents()){
+            LOG_ERROR("tcp fd:%d socket:%p %s", m_fd, this, strerror(errno));
+            Close();
+            return;
+        }
+    }
+    //剩下的和这期间新加入的数据在本轮末尾一起提交
+    Write();
+    ReleaseIdleBuffers();
+}
+
+void TcpSocket::HandleFlush(){
+    if(-1 == m_fd){
+        return;
+    }
+    Write(true);
+}
+
+bool TcpSocket::DropPendingConnection(){
+    if(m_reserveFd == -1){
+        return false;
+    }
+    close(m_reserveFd);
+    m_reserveFd = -1;
+    int afd = accept(m_fd, NULL, NULL);
+    if(afd != -1){
+        LOG_ERROR("tcp listenfd:%d fd:%d drop connection, too many open files", m_fd, afd);
+        close(afd);
+    }
+    m_reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return afd != -1;
+}
+
 void TcpSocket::Read(char* max_read_buffer, size_t max_read_size) {
+    //发送队列超过高水位暂停读取，降到低水位后恢复
+    if(m_readPaused){
+        return;
+    }
+    //后端接收的连接不能再自己读，只处理暂停期间存下的数据
+    if(m_container->HasRecvCompletion() && SocketState::connecting != m_state){
+        UnpackStashed();
+        return;
+    }
     SetLastAccessTime(time(NULL));
-    int n = recv(m_fd, max_read_buffer, max_read_size, 0);
-    if (n == -1) {
-        if(errno != EAGAIN){
-			return;
+    //边缘触发模式下需要一直读到EAGAIN，但每轮不超过容器的公平预算，防止饿死其他连接
+    bool edgeTriggered = m_container->IsEdgeTriggered();
+    BudgetTracker budget(m_container);
+    while(true){
+        int n = recv(m_fd, max_read_buffer, max_read_size, 0);
+        if (n == -1) {
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                return;
+            }
+            LOG_ERROR("tcp fd:%d socket:%p %s",m_fd, this, strerror(errno));
+            Close();
+            return;
         }
-		else{
-			LOG_ERROR("tcp fd:%d socket:%p %s",m_fd, this, strerror(errno));
+        else if (n == 0) {
+            LOG_INFO("tcp fd:%d socket:%p peer close %s:%u", m_fd, this, 
+                inet_ntoa(m_peerAddr.sin_addr), ntohs(m_peerAddr.sin_port));
             Close();
             return;
-		}
+        }
+
+        if(!Unpack(max_read_buffer, n)){
+            return;
+        }
+        //处理过程中进入了中继模式，剩下的数据交给中继；或者发送队列太长暂停了读取
+        if(m_relay || m_readPaused){
+            return;
+        }
+
+        //处理过程中连接可能已经被关闭；没读满说明接收缓冲区已经读空，新数据到来会再次触发事件
+        if(!edgeTriggered || m_state == SocketState::close || (size_t)n < max_read_size){
+            return;
+        }
+        if(budget.Consume(n)){
+            m_container->AddPendingSocket(this, SOCKET_EVENT_READ);
+            return;
+        }
     }
-	else if (n == 0) {
-        LOG_INFO("tcp fd:%d socket:%p peer close %s:%u", m_fd, this, 
-			inet_ntoa(m_peerAddr.sin_addr), ntohs(m_peerAddr.sin_port));
+}
+
+bool TcpSocket::Unpack(const char* data, size_t size){
+    if(nullptr == m_handler){
+        return true;
+    }
+    if(FrameType::proto == m_handler->GetFrameType()){
+        return UnpackFrames(data, size);
+    }
+    return UnpackRaw(data, size);
+}
+
+bool TcpSocket::UnpackRaw(const char* data, size_t size){
+    //之前没有剩余数据时直接解析读缓冲区，只把没处理的部分拷贝到接收缓冲区
+    const char* buf = data;
+    size_t len = size;
+    if(nullptr != m_input && !m_input->empty()){
+        if(!m_input->append(data, size)){
+            LOG_ERROR("tcp fd:%d socket:%p input overflow size:%zu", m_fd, this, m_input->size());
+            Close();
+            return false;
+        }
+        buf = m_input->data();
+        len = m_input->size();
+    }
+
+    int pn = m_handler->HandlePacket(buf, len, this);
+    if(m_state == SocketState::close){
+        return false;
+    }
+    if(pn < 0){
+        //解包失败
+        LOG_ERROR("tcp fd:%d socket:%p unpack failed",m_fd, this);
         Close();
-        return;
+        return false;
+    }
+    if((size_t)pn > len){
+        pn = len;
+    }
+    LOG_DEBUG("tcp fd:%d socket:%p unpack size:%d", m_fd, this, pn);
+
+    if(buf != data){
+        m_input->erase(0, pn);
+    }
+    else if((size_t)pn < len && !Input()->append(data + pn, len - pn)){
+        LOG_ERROR("tcp fd:%d socket:%p input overflow size:%zu", m_fd, this, len - pn);
+        Close();
+        return false;
     }
-	else{
-		m_input->append(max_read_buffer, n);
-		
-        int pn = 0;
+    return true;
+}
 
-        if(m_handler){
-            m_handler->HandlePacket(m_input->data(), m_input->size(), this);
+bool TcpSocket::UnpackFrames(const char* data, size_t size){
+    const char* p = data;
+    size_t left = size;
+    //先用新数据把接收缓冲区里不完整的包补齐，只拷贝缺的部分
+    if(nullptr != m_input && !m_input->empty()){
+        if(m_input->size() < sizeof(uint16_t)){
+            //长度字段还不完整
+            size_t n = std::min(sizeof(uint16_t) - m_input->size(), left);
+            if(!m_input->append(p, n)){
+                LOG_ERROR("tcp fd:%d socket:%p input overflow size:%zu", m_fd, this, m_input->size());
+                Close();
+                return false;
+            }
+            p += n;
+            left -= n;
+            if(m_input->size() < sizeof(uint16_t)){
+                return true;
+            }
+        }
+        size_t len = Decoder::pickLen(m_input->data());
+        if(len < Decoder::minSize()){
+            LOG_ERROR("tcp fd:%d socket:%p invalid packet length:%zu", m_fd, this, len);
+            Close();
+            return false;
+        }
+        if(m_input->size() < len){
+            size_t n = std::min(len - m_input->size(), left);
+            if(!m_input->append(p, n)){
+                LOG_ERROR("tcp fd:%d socket:%p input overflow size:%zu", m_fd, this, m_input->size());
+                Close();
+                return false;
+            }
+            p += n;
+            left -= n;
+            if(m_input->size() < len){
+                return true;
+            }
         }
+        if(!DispatchFrame(m_input->data(), len)){
+            return false;
+        }
+        m_input->erase();
+    }
 
-		if(pn > 0){
-			m_input->erase(0,pn);
-			LOG_DEBUG("tcp fd:%d socket:%p unpack size:%d", m_fd, this, pn);
-		}
-		else if(pn == 0){
-			LOG_DEBUG("tcp fd:%d socket:%p unpack size:0", m_fd, this);
-		}
-		else{
-			//解包失败
-			LOG_ERROR("tcp fd:%d socket:%p unpack failed",m_fd, this);
-			Close();
-		}
-		return;
-	}
+    //完整的包直接从读缓冲区分发，不拷贝
+    while(left >= sizeof(uint16_t)){
+        size_t len = Decoder::pickLen(p);
+        if(len < Decoder::minSize()){
+            LOG_ERROR("tcp fd:%d socket:%p invalid packet length:%zu", m_fd, this, len);
+            Close();
+            return false;
+        }
+        //进入中继模式后剩下的数据不再分包
+        if(left < len || m_relay){
+            break;
+        }
+        if(!DispatchFrame(p, len)){
+            return false;
+        }
+        p += len;
+        left -= len;
+    }
+
+    //剩下不完整的包缓存起来等后续数据
+    if(left > 0 && !Input()->append(p, left)){
+        LOG_ERROR("tcp fd:%d socket:%p input overflow size:%zu", m_fd, this, left);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool TcpSocket::DispatchFrame(const char* data, size_t size){
+    int pn = m_handler->HandlePacket(data, size, this);
+    if(m_state == SocketState::close){
+        return false;
+    }
+    if(pn < 0){
+        //解包失败
+        LOG_ERROR("tcp fd:%d socket:%p unpack failed cmd:%u seq:%u",m_fd, this, 
+            Decoder::pickCmd(data), Decoder::pickSeq(data));
+        Close();
+        return false;
+    }
+    LOG_DEBUG("tcp fd:%d socket:%p unpack size:%zu", m_fd, this, size);
+    return true;
 }
 
-void TcpSocket::Write() {
+void TcpSocket::Write(bool flush) {
+    //连接建立之前只排队，连上之后在HandleWrite里发送
+    if(SocketState::connecting == m_state){
+        return;
+    }
 	SetLastAccessTime(time(NULL));
-    if(m_output->size() < 1){
+    //发送已经交给容器后端，完成后在HandleSendComplete里继续
+    if(m_sendInFlight || nullptr == m_output || m_output->Empty()){
+        return;
+    }
+    //中继模式下发送队列由中继在管道数据之前发出去
+    if(m_relay){
+        m_relay->HandleWrite(this);
         return;
     }
 
+    //边缘触发模式下每轮发送不超过容器的公平预算，防止饿死其他连接
+    bool edgeTriggered = m_container->IsEdgeTriggered();
+    BudgetTracker budget(m_container);
+    struct iovec iov[IOV_MAX];
     while(true){
-        int n = send(m_fd, m_output->data(), m_output->size(), 0);
+        bool zeroCopy = false;
+        int fileFd = -1;
+        off_t fileOffset = 0;
+        size_t fileSize = 0, fileTotal = 0;
+        bool isFile = m_output->FrontFile(&fileFd, &fileOffset, &fileSize, &fileTotal);
+        ssize_t n = 0;
+        if(isFile){
+            n = SendFileData(fileFd, fileOffset, fileSize);
+            if(0 == n){
+                //文件比要发送的长度短，对端收不到完整数据，只能关闭连接
+                LOG_ERROR("tcp fd:%d socket:%p file fd:%d offset:%lld reach end of file", 
+                    m_fd, this, fileFd, (long long)fileOffset);
+                Close();
+                return;
+            }
+        }
+        else{
+            int iovcnt = m_output->GetIov(iov, IOV_MAX, m_zeroCopyThreshold, &zeroCopy);
+            //后端完成发送时本轮的数据攒到事件循环末尾一起提交，提交不了再自己发
+            if(!zeroCopy && m_container->HasRecvCompletion()){
+                if(!flush){
+                    m_container->AddFlushSocket(this);
+                    return;
+                }
+                if(m_container->SubmitSend(this, iov, iovcnt)){
+                    m_sendInFlight = true;
+                    return;
+                }
+            }
+            n = zeroCopy ? SendZeroCopy(iov, &zeroCopy) : writev(m_fd, iov, iovcnt);
+        }
         if (n == -1) {
+            if(errno == EINTR){
+                continue;
+            }
             //没发完的需要等下次可以发的时候继续发
-            if(errno == EAGAIN){
-                if(!m_container->ModSocket(this, SOCKET_EVENT_READ|SOCKET_EVENT_WRITE|SOCKET_EVENT_ERROR)){
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                if(m_isResending){
+                    return;
+                }
+                m_isResending = true;
+                if(!UpdateEvents()){
                     LOG_ERROR("tcp fd:%d socket:%p %s", m_fd, this, strerror(errno));
                     Close();
                 }
                 else{
                     LOG_DEBUG("tcp fd:%d socket:%p resend", m_fd, this);
-                    m_isResending = true;
                 }
             }
             else{
@@ -340,20 +917,55 @@ void TcpSocket::Write() {
             return;
         }
         else{
-            m_output->erase(0, n);
-            if(m_output->size() <= 0){
+            if(zeroCopy){
+                m_output->ConsumeZeroCopy(n, m_zeroCopyNextId++);
+            }
+            else{
+                //文件发完时在Consume里调用HandleFileComplete
+                m_output->Consume(n);
+                if(isFile && (size_t)n < fileSize && m_handler){
+                    m_handler->HandleFileProgress(this, fileFd, fileTotal - fileSize + n, fileTotal);
+                }
+            }
+            m_sendStats.m_sentBytes += n;
+            CheckLowWaterMark();
+            //回调里可能关闭了连接
+            if(-1 == m_fd){
+                return;
+            }
+            if(m_output->Empty()){
                 //全部都发完了就不需要再关注可写事件
                 if(m_isResending){
                     m_isResending = false;
-                    if(!m_container->ModSocket(this, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+                    if(!UpdateEvents()){
                         LOG_ERROR("tcp fd:%d socket:%p %s", m_fd, this, strerror(errno));
                         Close();
                     }
                 }
                 return;
             }
+            if(edgeTriggered && budget.Consume(n)){
+                m_container->AddPendingSocket(this, SOCKET_EVENT_WRITE);
+                return;
+            }
+        }
+    }
+}
+
+ssize_t TcpSocket::SendFileData(int fd, off_t offset, size_t size){
+#ifdef __APPLE__
+    off_t len = size;
+    if(-1 == sendfile(fd, m_fd, offset, &len, NULL, 0)){
+        //发送了一部分后返回EAGAIN时len是已经发送的长度
+        if((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && len > 0){
+            return len;
         }
+        return -1;
     }
+    return len;
+#else
+    return sendfile(m_fd, fd, &offset, size);
+#endif
 }
 
 void TcpSocket::Close(){
@@ -365,9 +977,30 @@ void TcpSocket::Close(){
     m_container->DelSocket(this);
 
     if(m_fd != -1){
-        //关闭描述符 
+        //还有零拷贝发送没有完成时内核仍引用着这些数据，下面Clear之后内存就会被复用，
+        //用RST关闭让内核直接丢弃发送队列，不再发出已经失效的数据
+        if(nullptr != m_output && m_output->ZeroCopyPending() > 0){
+            struct linger lg = {1, 0};
+            setsockopt(m_fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        }
+        //关闭描述符
         close(m_fd);
     }
+    if(m_reserveFd != -1){
+        close(m_reserveFd);
+        m_reserveFd = -1;
+    }
+    //没发完的数据不再发送，转交所有权的数据及时释放
+    if(nullptr != m_output){
+        m_output->Clear();
+    }
+    m_sendInFlight = false;
+    //中继里的另一个连接也一起关闭
+    if(m_relay){
+        TcpRelay* relay = m_relay;
+        m_relay = nullptr;
+        relay->HandleClose(this);
+    }
 
     m_fd = -1;
     m_state = SocketState::close;
@@ -376,17 +1009,185 @@ void TcpSocket::Close(){
 }
 
 bool TcpSocket::SendPacket(const char* data, size_t size){
-    if(SocketState::accept != m_state && SocketState::connected != m_state){
+    if(SocketState::accept != m_state && SocketState::connected != m_state && SocketState::connecting != m_state){
         LOG_ERROR("tcp fd:%d socket:%p state:%s can't send", m_fd, this, toString(m_state).c_str());
         return false;
     }
 	if(nullptr == data || size < 1){
 		return true;
 	}
-	if(m_output->append(data, size)){
+	if(Output()->Append(data, size)){
         LOG_DEBUG("tcp fd:%d socket:%p send size:%zd success", m_fd, this, size);
+        m_sendStats.m_queuedBytes += size;
         Write();
+        CheckHighWaterMark();
         return true;
     }
+    m_sendStats.m_dropCount++;
+    LOG_ERROR("tcp fd:%d socket:%p send size:%zd failed, output size:%zu", m_fd, this, size, GetOutputSize());
+    return false;
+}
+
+void TcpSocket::SetWaterMark(size_t high, size_t low, bool pauseRead){
+    m_highWaterMark = high;
+    m_lowWaterMark = low < high ? low : high;
+    m_pauseReadOnHighWater = pauseRead;
+    CheckHighWaterMark();
+    CheckLowWaterMark();
+}
+
+bool TcpSocket::EnableNotSentLowat(uint32_t bytes){
+#ifdef TCP_NOTSENT_LOWAT
+    if(-1 == setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes))){
+        LOG_ERROR("tcp fd:%d socket:%p set TCP_NOTSENT_LOWAT:%u failed %s", m_fd, this, bytes, strerror(errno));
+        return false;
+    }
+    return true;
+#else
+    LOG_ERROR("tcp fd:%d socket:%p TCP_NOTSENT_LOWAT not supported", m_fd, this);
+    return false;
+#endif
+}
+
+void TcpSocket::CheckHighWaterMark(){
+    if(-1 == m_fd){
+        return;
+    }
+    size_t size = GetOutputSize();
+    if(size > m_sendStats.m_peakSize){
+        m_sendStats.m_peakSize = size;
+    }
+    if(0 == m_highWaterMark || m_aboveHighWater || size < m_highWaterMark){
+        return;
+    }
+    m_aboveHighWater = true;
+    m_sendStats.m_highWaterCount++;
+    LOG_DEBUG("tcp fd:%d socket:%p output size:%zu above high water mark:%zu", m_fd, this, size, m_highWaterMark);
+    //中继模式下关注的事件由中继管理
+    if(m_pauseReadOnHighWater && !m_relay){
+        m_readPaused = true;
+        if(!UpdateEvents()){
+            LOG_ERROR("tcp fd:%d socket:%p mod events failed", m_fd, this);
+            Close();
+            return;
+        }
+    }
+    if(m_handler){
+        m_handler->HandleHighWaterMark(this, size);
+    }
+}
+
+void TcpSocket::CheckLowWaterMark(){
+    if(-1 == m_fd || !m_aboveHighWater){
+        return;
+    }
+    size_t size = GetOutputSize();
+    if(size > m_lowWaterMark){
+        return;
+    }
+    m_aboveHighWater = false;
+    LOG_DEBUG("tcp fd:%d socket:%p output size:%zu below low water mark:%zu", m_fd, this, size, m_lowWaterMark);
+    if(m_readPaused){
+        m_readPaused = false;
+        if(!UpdateEvents()){
+            LOG_ERROR("tcp fd:%d socket:%p mod events failed", m_fd, this);
+            Close();
+            return;
+        }
+        //暂停期间没读的数据在边缘触发模式下不会再有事件；后端接收时处理暂停期间存下的数据
+        if(m_container->IsEdgeTriggered()){
+            m_container->AddPendingSocket(this, SOCKET_EVENT_READ);
+        }
+    }
+    if(m_handler){
+        m_handler->HandleLowWaterMark(this, size);
+    }
+}
+
+bool TcpSocket::UpdateEvents(){
+    uint64_t events = SOCKET_EVENT_ERROR;
+    if(!m_readPaused){
+        events |= SOCKET_EVENT_READ|SOCKET_EVENT_RECV;
+    }
+    if(m_isResending){
+        events |= SOCKET_EVENT_WRITE;
+    }
+    return m_container->ModSocket(this, events);
+}
+
+bool TcpSocket::SendFile(int fd, off_t offset, size_t len){
+    if(SocketState::accept != m_state && SocketState::connected != m_state && SocketState::connecting != m_state){
+        LOG_ERROR("tcp fd:%d socket:%p state:%s can't send file", m_fd, this, toString(m_state).c_str());
+        return false;
+    }
+    PacketHandler* handler = m_handler;
+    bool ret = Output()->AppendFile(fd, offset, len, [this, handler, fd](bool success){
+        if(handler){
+            handler->HandleFileComplete(this, fd, success);
+        }
+    });
+    if(!ret){
+        LOG_ERROR("tcp fd:%d socket:%p send file fd:%d failed", m_fd, this, fd);
+        return false;
+    }
+    LOG_DEBUG("tcp fd:%d socket:%p send file fd:%d offset:%lld len:%zu", m_fd, this, fd, (long long)offset, len);
+    m_sendStats.m_queuedBytes += len;
+    Write();
+    CheckHighWaterMark();
+    return true;
+}
+
+bool TcpSocket::SendPacket(const IOBuf& buf){
+    if(SocketState::accept != m_state && SocketState::connected != m_state && SocketState::connecting != m_state){
+        LOG_ERROR("tcp fd:%d socket:%p state:%s can't send", m_fd, this, toString(m_state).c_str());
+        return false;
+    }
+    if(buf.Empty()){
+        return true;
+    }
+    SendQueue* output = Output();
+    //先检查能不能整个放下，不能只发一部分
+    if(buf.Size() > output->Available()){
+        m_sendStats.m_dropCount++;
+        LOG_ERROR("tcp fd:%d socket:%p send size:%zu failed, output size:%zu", m_fd, this, buf.Size(), GetOutputSize());
+        return false;
+    }
+    //小片单独成段不如拷贝到发送队列的块里合并发送
+    buf.ShareSlices([output](const char* data, size_t size, const std::function<void()>& release){
+        if(size < TCP_IOBUF_SHARE_SIZE){
+            output->Append(data, size);
+            release();
+        }
+        else{
+            output->Append(data, size, release);
+        }
+    });
+    LOG_DEBUG("tcp fd:%d socket:%p send iobuf size:%zu slices:%zu success", m_fd, this, buf.Size(), buf.SliceCount());
+    m_sendStats.m_queuedBytes += buf.Size();
+    Write();
+    CheckHighWaterMark();
+    return true;
+}
+
+bool TcpSocket::SendPacket(const char* data, size_t size, const std::function<void()>& release){
+    if(SocketState::accept != m_state && SocketState::connected != m_state && SocketState::connecting != m_state){
+        LOG_ERROR("tcp fd:%d socket:%p state:%s can't send", m_fd, this, toString(m_state).c_str());
+        if(release){
+            release();
+        }
+        return false;
+    }
+	if(Output()->Append(data, size, release)){
+        LOG_DEBUG("tcp fd:%d socket:%p send size:%zd success", m_fd, this, size);
+        m_sendStats.m_queuedBytes += size;
+        Write();
+        CheckHighWaterMark();
+        return true;
+    }
+    m_sendStats.m_dropCount++;
+    LOG_ERROR("tcp fd:%d socket:%p send size:%zd failed, output size:%zu", m_fd, this, size, GetOutputSize());
+    if(release){
+        release();
+    }
     return false;
 }
\ No newline at end of file
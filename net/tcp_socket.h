@@ -11,20 +11,41 @@
 #include <errno.h>
 #include <cstring>
 #include <arpa/inet.h>
+#include <algorithm>
+#include <typeinfo>
 
 #include "socket_base.h"
-#include "blockbuffer.h"
+#include "ringbuffer.h"
+#include "iobuf.h"
+#include "send_queue.h"
+#include "tcp_relay.h"
 #include "../sys/log.h"
 #include "../sys/util.h"
 
 namespace deps{
+//发送队列统计，只在事件循环线程里累加
+struct TcpSendStats{
+    TcpSendStats():m_queuedBytes(0), m_sentBytes(0), m_peakSize(0), m_highWaterCount(0), m_dropCount(0){}
+    uint64_t m_queuedBytes;     //进入发送队列的字节数
+    uint64_t m_sentBytes;       //发送出去的字节数
+    size_t m_peakSize;          //发送队列的最大长度
+    uint64_t m_highWaterCount;  //超过高水位的次数
+    uint64_t m_dropCount;       //发送队列满了发送失败的次数
+};
+
 class TcpSocket: public SocketBase{
 public:
-	static bool Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler);
+	static bool Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler, bool reusePort = false);
+    //创建非阻塞的监听描述符，失败返回-1
+    static int CreateListenFd(int port, int backlog, bool reusePort);
+    //把已经在监听的描述符加入容器，失败时关闭描述符；exclusive表示多个容器共享这个监听描述符，每次只唤醒一个
+    static bool ListenFd(int fd, int port, SocketContainer *pContainer, PacketHandler* handler, bool exclusive);
     static SocketBase* Connect(uint32_t ip, int port, SocketContainer *pContainer, PacketHandler* handler); 
 
     TcpSocket(SocketContainer *pContainer, PacketHandler* handler);
     ~TcpSocket();
+    //优先从容器的回收池里取对象，池里没有时new
+    static TcpSocket* Create(SocketContainer *pContainer, PacketHandler* handler);
     TcpSocket()=delete;
     TcpSocket(const TcpSocket&)=delete;
     TcpSocket& operator=(const TcpSocket&)=delete;
@@ -33,16 +54,104 @@ public:
 	virtual void HandleWrite();
     virtual void HandleError();
     virtual void HandleTimeout();
+    //容器后端完成式收发的回调，见SocketContainer::HasRecvCompletion
+    virtual void HandleRecv(const char* data, int result);
+    virtual void HandleAccept(int fd);
+    virtual void HandleSendComplete(int result);
+    virtual void HandleFlush();
+    //connecting状态下发送的数据先排队，连接建立后按顺序发出
     virtual bool SendPacket(const char* data, size_t size);
+    virtual bool SendPacket(const char* data, size_t size, const std::function<void()>& release);
+    //每一片直接挂到发送队列上，不拷贝，发完后释放引用(小于TCP_IOBUF_SHARE_SIZE的片拷贝)；放不下时整个失败
+    bool SendPacket(const IOBuf& buf);
     virtual void Close();
-private:	
+    virtual bool Recycle();
+    /**
+     * @brief 发送文件fd从offset开始的len字节，和SendPacket的数据按顺序排队，用sendfile发送，
+     * 文件内容不经过用户态。发送过程中调用PacketHandler::HandleFileProgress，
+     * 结束时调用PacketHandler::HandleFileComplete，在此之前fd不能关闭。
+     */
+    bool SendFile(int fd, off_t offset, size_t len);
+    /**
+     * @brief 打开MSG_ZEROCOPY发送：不小于threshold的数据段发送时不再拷贝到内核，
+     * 内核发送完成后通过错误队列通知，收到通知才释放数据段。只有linux 4.14以上支持，
+     * 本机回环地址上内核仍然会拷贝(计入GetZeroCopyCopiedBytes)。
+     */
+    bool EnableZeroCopy(size_t threshold = TCP_ZEROCOPY_THRESHOLD);
+    //零拷贝发送完成的字节数
+    uint64_t GetZeroCopyBytes(){return m_zeroCopyBytes;}
+    //达到阈值但最终还是被拷贝的字节数：内核报告拷贝了，或者锁定内存不够退回普通发送
+    uint64_t GetZeroCopyCopiedBytes(){return m_zeroCopyCopiedBytes;}
+    /**
+     * @brief 设置发送队列的高低水位(字节，包括SendFile还没发的部分)，high为0表示不检查。
+     * 队列长度涨到high时调用PacketHandler::HandleHighWaterMark，pauseRead为true时同时暂停读取对端的数据；
+     * 降到low时调用PacketHandler::HandleLowWaterMark并恢复读取。
+     */
+    void SetWaterMark(size_t high, size_t low, bool pauseRead = false);
+    /**
+     * @brief 设置TCP_NOTSENT_LOWAT：内核里没发出去的数据超过bytes时不再可写，
+     * 数据留在发送队列里由水位控制，内核队列保持较短，延迟更稳定
+     */
+    bool EnableNotSentLowat(uint32_t bytes = TCP_NOTSENT_LOWAT_SIZE);
+    size_t GetOutputSize(){return nullptr == m_output ? 0 : m_output->Size();}
+    const TcpSendStats& GetSendStats(){return m_sendStats;}
+    //所在的中继，没有中继时返回nullptr，见TcpRelay::Create
+    TcpRelay* GetRelay(){return m_relay;}
+private:
+    friend class TcpRelay;	
+    //把除了容器、协议解析和缓冲区对象以外的成员恢复成初始值
+    void Reset();
     void Accept();
+    //把接收到的连接描述符afd加入容器，addr为nullptr时第一次用到对端地址再取
+    void AddAccepted(int afd, const struct sockaddr_in* addr);
+    //描述符用完时，用预留的描述符接收并立即关闭一个连接，避免连接一直堆在backlog里反复触发可读
+    bool DropPendingConnection();
     void Read(char* max_read_buffer, size_t max_read_size);
-    void Write();
+    //把收到的数据交给协议解析，返回false表示连接已经关闭
+    bool Unpack(const char* data, size_t size);
+    bool UnpackRaw(const char* data, size_t size);
+    bool UnpackFrames(const char* data, size_t size);
+    //后端接收时，处理暂停读取期间存进接收缓冲区的数据
+    void UnpackStashed();
+    //把一个完整的包交给协议解析，返回false表示连接已经关闭
+    bool DispatchFrame(const char* data, size_t size);
+    //flush为true表示在HandleFlush里调用：后端完成发送时，本轮攒下的数据这时才提交
+    void Write(bool flush = false);
     bool EnableTcpKeepAlive(int aliveTime, int interval, int count);
     bool EnableTcpNoDelay();
-    BlockBuffer<def_block_alloc_4k, 1024>* m_input;              //接收缓冲区
-    BlockBuffer<def_block_alloc_4k, 1024>* m_output;             //发送缓冲区
+    //读取错误队列里的零拷贝完成通知并释放数据段，返回是否读到了通知
+    bool ReadZeroCopyCompletions();
+    //用MSG_ZEROCOPY发送iov[0]，退回普通发送时把*zeroCopy置为false
+    ssize_t SendZeroCopy(struct iovec* iov, bool* zeroCopy);
+    //用sendfile发送文件fd从offset开始的最多size字节
+    ssize_t SendFileData(int fd, off_t offset, size_t size);
+    //数据入队后检查是否超过高水位，发送后检查是否降到低水位
+    void CheckHighWaterMark();
+    void CheckLowWaterMark();
+    //根据是否暂停读取、是否在等可写重新设置关注的事件
+    bool UpdateEvents();
+    //接收缓冲区和发送队列第一次用到时才创建
+    RingBuffer<def_block_alloc_4k, 1024>* Input();
+    SendQueue* Output();
+    //PacketHandler::ReleaseIdleBuffers返回true时，释放空的接收缓冲区和已经发完的发送队列
+    void ReleaseIdleBuffers();
+    RingBuffer<def_block_alloc_4k, 1024>* m_input;              //接收缓冲区，没有用到时为nullptr
+    SendQueue* m_output;                                         //发送队列，没有用到时为nullptr
+    TcpRelay* m_relay;                                           //中继模式下读写都交给中继
+    int m_reserveFd;                                             //监听描述符预留的描述符，应对EMFILE
+    uint32_t m_zeroCopyNextId;                                   //下一次零拷贝发送的完成通知序号
+    size_t m_zeroCopyThreshold;                                  //零拷贝发送的最小数据段，0表示不使用
+    uint64_t m_zeroCopyBytes;
+    uint64_t m_zeroCopyCopiedBytes;
+    size_t m_highWaterMark;                                      //发送队列高水位，0表示不检查
+    size_t m_lowWaterMark;                                       //发送队列低水位
+    //几个标志放在一起，减少连接对象的对齐填充
     bool m_isResending;                                          //是否正在重发
+    bool m_pauseReadOnHighWater;                                 //超过高水位时是否暂停读取
+    bool m_aboveHighWater;                                       //发送队列是否超过了高水位还没降到低水位
+    bool m_readPaused;                                           //是否暂停了读取
+    bool m_sendInFlight;                                         //是否有交给容器后端还没完成的发送
+    bool m_recvStashed;                                          //接收缓冲区里有暂停读取期间后端送达、还没处理的数据
+    TcpSendStats m_sendStats;
 };
 }
\ No newline at end of file
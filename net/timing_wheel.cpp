@@ -0,0 +1,177 @@
+#include <stdint.h>
+#include "timing_wheel.h"
+
+using namespace deps;
+
+TimingWheel::TimingWheel(uint64_t nowMs){
+    m_current = nowMs;
+    m_size = 0;
+    for(int i = 0; i < ROOT_SIZE; ++i){
+        m_root[i].m_prev = m_root[i].m_next = &m_root[i];
+    }
+    for(int l = 0; l < LEVELS; ++l){
+        for(int i = 0; i < LEVEL_SIZE; ++i){
+            m_levels[l][i].m_prev = m_levels[l][i].m_next = &m_levels[l][i];
+        }
+    }
+}
+
+TimingWheel::~TimingWheel(){
+    //只摘下节点，节点内存归使用者
+    for(int i = 0; i < ROOT_SIZE; ++i){
+        while(m_root[i].m_next != &m_root[i]){
+            Unlink(m_root[i].m_next);
+        }
+    }
+    for(int l = 0; l < LEVELS; ++l){
+        for(int i = 0; i < LEVEL_SIZE; ++i){
+            while(m_levels[l][i].m_next != &m_levels[l][i]){
+                Unlink(m_levels[l][i].m_next);
+            }
+        }
+    }
+    m_size = 0;
+}
+
+void TimingWheel::Link(TimerNode* head, TimerNode* node){
+    node->m_prev = head->m_prev;
+    node->m_next = head;
+    head->m_prev->m_next = node;
+    head->m_prev = node;
+}
+
+void TimingWheel::Unlink(TimerNode* node){
+    node->m_prev->m_next = node->m_next;
+    node->m_next->m_prev = node->m_prev;
+    node->m_prev = nullptr;
+    node->m_next = nullptr;
+}
+
+void TimingWheel::Insert(TimerNode* node){
+    uint64_t expire = node->m_expire;
+    //已经过期的放到下一个要处理的槽
+    if(expire < m_current){
+        expire = m_current;
+    }
+    uint64_t delta = expire - m_current;
+    if(delta < ROOT_SIZE){
+        Link(&m_root[expire & ROOT_MASK], node);
+        return;
+    }
+    for(int l = 0; l < LEVELS; ++l){
+        int shift = ROOT_BITS + (l + 1) * LEVEL_BITS;
+        if(delta < ((uint64_t)1 << shift) || l == LEVELS - 1){
+            if(l == LEVELS - 1 && delta >= ((uint64_t)1 << shift)){
+                //超出最大范围的按最大范围处理，到期回调时由使用者自行判断
+                expire = m_current + ((uint64_t)1 << shift) - 1;
+                node->m_expire = expire;
+            }
+            int index = (int)((expire >> (ROOT_BITS + l * LEVEL_BITS)) & LEVEL_MASK);
+            Link(&m_levels[l][index], node);
+            return;
+        }
+    }
+}
+
+void TimingWheel::Add(TimerNode* node, uint64_t expireMs){
+    if(node->IsActive()){
+        Unlink(node);
+        --m_size;
+    }
+    node->m_expire = expireMs;
+    Insert(node);
+    ++m_size;
+}
+
+void TimingWheel::Del(TimerNode* node){
+    if(!node->IsActive()){
+        return;
+    }
+    Unlink(node);
+    --m_size;
+}
+
+bool TimingWheel::Cascade(int level){
+    int index = (int)((m_current >> (ROOT_BITS + level * LEVEL_BITS)) & LEVEL_MASK);
+    TimerNode* head = &m_levels[level][index];
+    //先整体摘下来，再逐个重新插入，重新插入时一定落到更低层
+    TimerNode list;
+    list.m_prev = list.m_next = &list;
+    if(head->m_next != head){
+        list.m_next = head->m_next;
+        list.m_prev = head->m_prev;
+        list.m_next->m_prev = &list;
+        list.m_prev->m_next = &list;
+        head->m_prev = head->m_next = head;
+    }
+    while(list.m_next != &list){
+        TimerNode* node = list.m_next;
+        Unlink(node);
+        Insert(node);
+    }
+    return index == 0;
+}
+
+uint64_t TimingWheel::NextExpireMs() const{
+    if(0 == m_size){
+        return UINT64_MAX;
+    }
+    uint64_t next = UINT64_MAX;
+    for(uint64_t t = m_current; t < m_current + ROOT_SIZE; ++t){
+        const TimerNode* head = &m_root[t & ROOT_MASK];
+        if(head->m_next != head){
+            next = t;
+            break;
+        }
+    }
+    //第一层转到0号槽时级联：第二层对应的槽不空，或者还要继续往上级联，就按这个时刻算
+    uint64_t wrap = (m_current + ROOT_MASK) & ~(uint64_t)ROOT_MASK;
+    for(int i = 0; i < LEVEL_SIZE && wrap < next; ++i, wrap += ROOT_SIZE){
+        int index = (int)((wrap >> ROOT_BITS) & LEVEL_MASK);
+        const TimerNode* head = &m_levels[0][index];
+        if(head->m_next != head || 0 == index){
+            return wrap;
+        }
+    }
+    return next;
+}
+
+size_t TimingWheel::Expire(uint64_t nowMs){
+    size_t count = 0;
+    while(m_current <= nowMs){
+        if(0 == m_size){
+            //没有定时器直接跳到当前时间
+            m_current = nowMs + 1;
+            break;
+        }
+        int index = (int)(m_current & ROOT_MASK);
+        if(0 == index){
+            for(int l = 0; l < LEVELS && Cascade(l); ++l){
+            }
+        }
+
+        TimerNode* head = &m_root[index];
+        TimerNode list;
+        list.m_prev = list.m_next = &list;
+        if(head->m_next != head){
+            list.m_next = head->m_next;
+            list.m_prev = head->m_prev;
+            list.m_next->m_prev = &list;
+            list.m_prev->m_next = &list;
+            head->m_prev = head->m_next = head;
+        }
+        //先推进时间，回调里重新添加的已到期定时器会落到下一个槽
+        ++m_current;
+
+        while(list.m_next != &list){
+            TimerNode* node = list.m_next;
+            Unlink(node);
+            --m_size;
+            ++count;
+            if(node->m_callback){
+                node->m_callback(node, node->m_arg);
+            }
+        }
+    }
+    return count;
+}
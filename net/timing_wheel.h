@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace deps{
+/**
+ * @brief 定时器节点，侵入式双向链表节点，由使用者自己持有内存
+ */
+struct TimerNode{
+    TimerNode():m_prev(nullptr), m_next(nullptr), m_expire(0), m_callback(nullptr), m_arg(nullptr){}
+    //是否已经挂在时间轮上
+    bool IsActive() const {return m_next != nullptr;}
+
+    TimerNode* m_prev;
+    TimerNode* m_next;
+    uint64_t m_expire;                                  //到期时间(单调时钟，单位是毫秒)
+    void (*m_callback)(TimerNode* node, void* arg);     //到期回调，回调时节点已经从时间轮上摘下
+    void* m_arg;                                        //回调参数
+};
+
+/**
+ * @brief 分层时间轮：第一层256个槽，每槽1毫秒；往上四层各64个槽，逐层放大64倍，
+ * 最长定时约49天，超过的按最长处理。添加、删除都是O(1)，推进时只访问到期的槽。
+ */
+class TimingWheel{
+public:
+    TimingWheel(uint64_t nowMs);
+    ~TimingWheel();
+    TimingWheel(const TimingWheel&)=delete;
+    TimingWheel& operator=(const TimingWheel&)=delete;
+
+    //添加或者重新设置定时器，expireMs为到期时间(单调时钟毫秒)
+    void Add(TimerNode* node, uint64_t expireMs);
+    //删除定时器，不在时间轮上也没有副作用
+    void Del(TimerNode* node);
+    //把时间推进到nowMs，回调所有到期的定时器，返回回调个数
+    size_t Expire(uint64_t nowMs);
+    /**
+     * @brief 最早需要调用Expire的时刻：第一层最近的非空槽，或者更早的一次会把定时器级联下来的时刻，
+     * 高层的槽只按级联时刻估计，所以可能比真正的到期时间早。没有定时器时返回UINT64_MAX
+     */
+    uint64_t NextExpireMs() const;
+    size_t Size() const {return m_size;}
+private:
+    enum { ROOT_BITS = 8, LEVEL_BITS = 6, LEVELS = 4 };
+    enum { ROOT_SIZE = 1 << ROOT_BITS, LEVEL_SIZE = 1 << LEVEL_BITS };
+    enum { ROOT_MASK = ROOT_SIZE - 1, LEVEL_MASK = LEVEL_SIZE - 1 };
+
+    void Insert(TimerNode* node);
+    //把高层槽里的定时器重新分配到低层，返回下一层是否也需要级联
+    bool Cascade(int level);
+    static void Link(TimerNode* head, TimerNode* node);
+    static void Unlink(TimerNode* node);
+private:
+    uint64_t m_current;                         //下一个要处理的时刻(毫秒)
+    size_t m_size;
+    TimerNode m_root[ROOT_SIZE];
+    TimerNode m_levels[LEVELS][LEVEL_SIZE];
+};
+}
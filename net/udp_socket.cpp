@@ -1,17 +1,91 @@
 #include "udp_socket.h"
+#ifndef __APPLE__
+#include <netinet/udp.h>
+#endif
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
 
 using namespace deps;
 
+#ifndef __APPLE__
+//批量接收用的缓冲区，每个数据报一个MAX_READ_BUFF_SIZE的槽，保证不会被截断
+struct UdpSocket::RecvBatch{
+    RecvBatch(){
+        memset(m_msgs, 0, sizeof(m_msgs));
+        for(int i = 0; i < UDP_BATCH_SIZE; ++i){
+            m_iovs[i].iov_base = m_slab[i];
+            m_iovs[i].iov_len = MAX_READ_BUFF_SIZE;
+            m_msgs[i].msg_hdr.msg_iov = &m_iovs[i];
+            m_msgs[i].msg_hdr.msg_iovlen = 1;
+            m_msgs[i].msg_hdr.msg_name = &m_addrs[i];
+        }
+    }
+    struct mmsghdr m_msgs[UDP_BATCH_SIZE];
+    struct iovec m_iovs[UDP_BATCH_SIZE];
+    struct sockaddr_in m_addrs[UDP_BATCH_SIZE];
+    char m_control[UDP_BATCH_SIZE][CMSG_SPACE(sizeof(int))];   //UDP_GRO带回的段大小
+    char m_slab[UDP_BATCH_SIZE][MAX_READ_BUFF_SIZE];
+};
+#else
+struct UdpSocket::RecvBatch{
+};
+#endif
+
 UdpSocket::UdpSocket(SocketContainer *pContainer, PacketHandler* handler){
     m_container = pContainer;
     m_handler = handler;
+    m_input = new BlockBuffer<def_block_alloc_4k, 1024>;
+    m_input->set_role(BUFFER_ROLE_SOCKET_INPUT);
+    m_recvBatch = nullptr;
+    Reset();
+}
+
+UdpSocket* UdpSocket::Create(SocketContainer *pContainer, PacketHandler* handler){
+    UdpSocket* s = (UdpSocket*)pContainer->AcquireSocket(SocketType::udp);
+    if(nullptr == s){
+        return new UdpSocket(pContainer, handler);
+    }
+    s->m_handler = handler;
+    return s;
+}
+
+bool UdpSocket::Recycle(){
+    //派生类的对象不能当作UdpSocket复用
+    if(typeid(*this) != typeid(UdpSocket)){
+        return false;
+    }
+    //批量接收缓冲区有好几MB，池里的对象不占着，再次使用时第一次读再分配
+    delete m_recvBatch;
+    m_recvBatch = nullptr;
+    m_input->erase();
+    m_handler = nullptr;
+    Reset();
+    return true;
+}
+
+void UdpSocket::Reset(){
     m_fd = -1;
     m_state = SocketState::close;
 	m_type = SocketType::udp;
     m_createTime = 0;
     m_lastAccessTime = 0;
     m_timeout = 0;
-    m_input = new BlockBuffer<def_block_alloc_4k, 1024>;
+    m_id = 0;
+    bzero(&m_peerAddr, sizeof(m_peerAddr));
+    m_batch = false;
+    m_gso = false;
+    m_gro = false;
+    m_sendBuffer.clear();
+    m_sendEntries.clear();
+    m_sendBlocked = false;
 }
 
 UdpSocket::~UdpSocket(){
@@ -25,6 +99,8 @@ UdpSocket::~UdpSocket(){
     m_timeout = 0;
     delete m_input;
     m_input = nullptr;
+    delete m_recvBatch;
+    m_recvBatch = nullptr;
 }
 
 void UdpSocket::SetRecvBufferSize(uint32_t size)
@@ -73,11 +149,33 @@ void UdpSocket::SetSendBufferSize(uint32_t size)
 
 void UdpSocket::HandleRead(char* max_read_buffer, size_t max_read_size){
 	LOG_DEBUG("udp fd:%d socket:%p state:%s read", m_fd, this, toString(m_state).c_str());
-	Read(max_read_buffer, max_read_size);
+    if(m_batch){
+        ReadBatch();
+    }
+    else{
+	    Read(max_read_buffer, max_read_size);
+    }
 }
 
 void UdpSocket::HandleWrite(){
-    LOG_ERROR("udp fd:%d socket:%p state:%s write", m_fd, this, toString(m_state).c_str());
+    if(!m_sendBlocked){
+        LOG_ERROR("udp fd:%d socket:%p state:%s write", m_fd, this, toString(m_state).c_str());
+        return;
+    }
+    //发送缓冲区有空间了，继续发送排队的数据报
+    m_sendBlocked = false;
+    if(!m_container->ModSocket(this, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+        LOG_ERROR("udp fd:%d socket:%p %s", m_fd, this, strerror(errno));
+        Close();
+        return;
+    }
+    FlushBatch();
+}
+
+void UdpSocket::HandleFlush(){
+    if(!m_sendBlocked){
+        FlushBatch();
+    }
 }
 
 void UdpSocket::HandleError(){
@@ -96,7 +194,7 @@ void UdpSocket::HandleTimeout(){
     }
 }
 
-bool UdpSocket::Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler){
+bool UdpSocket::Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler, int mode){
 	int fd = socket(AF_INET, SOCK_DGRAM, 0);
 	if (fd == -1) {
         LOG_ERROR("udp %s", strerror(errno));
@@ -125,11 +223,12 @@ bool UdpSocket::Listen(int port, int backlog, SocketContainer *pContainer, Packe
         return false;
 	}
 
-    UdpSocket *s = new UdpSocket(pContainer, handler);
+    UdpSocket *s = UdpSocket::Create(pContainer, handler);
     s->SetFd(fd);
     s->SetCreateTime(time(NULL));
     s->SetLastAccessTime(s->GetCreateTime());
     s->SetState(SocketState::listen);
+    s->SetMode(mode);
 	LOG_DEBUG("udp fd:%d socket:%p new socket", fd, s);
     if(!pContainer->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
         LOG_ERROR("fd:%d add events failed", fd);
@@ -139,11 +238,14 @@ bool UdpSocket::Listen(int port, int backlog, SocketContainer *pContainer, Packe
 
 	s->SetRecvBufferSize(UDP_RECV_BUFF_SIZE);
 	s->SetSendBufferSize(UDP_SEND_BUFF_SIZE);
+    if(UDP_MODE_OFFLOAD == (mode & UDP_MODE_OFFLOAD)){
+        s->EnableOffload();
+    }
     LOG_INFO("udp fd:%d socket:%p listen port:%d", fd, s, port);
     return true;
 }
 
-SocketBase* UdpSocket::Connect(uint32_t ip, int port, SocketContainer *pContainer, PacketHandler* handler){
+SocketBase* UdpSocket::Connect(uint32_t ip, int port, SocketContainer *pContainer, PacketHandler* handler, int mode){
     int fd = socket(AF_INET,SOCK_DGRAM,0);
     if(fd == -1){
         LOG_ERROR("udp %s %s:%u",strerror(errno), UintIP2String(ip).c_str(), port);
@@ -162,14 +264,18 @@ SocketBase* UdpSocket::Connect(uint32_t ip, int port, SocketContainer *pContaine
     peerAddr.sin_port=htons(port);
     peerAddr.sin_addr.s_addr=ip;
 
-    UdpSocket *s = new UdpSocket(pContainer, handler);
+    UdpSocket *s = UdpSocket::Create(pContainer, handler);
     s->SetFd(fd);
     s->SetCreateTime(time(NULL));
     s->SetLastAccessTime(s->GetCreateTime());
     s->SetPeerAddr(peerAddr);
+    s->SetMode(mode);
 	LOG_DEBUG("udp fd:%d socket:%p new socket %s:%u", fd, s, UintIP2String(ip).c_str(), port);
     s->SetState(SocketState::connected);
     if(pContainer->AddSocket(s, SOCKET_EVENT_READ|SOCKET_EVENT_ERROR)){
+        if(UDP_MODE_OFFLOAD == (mode & UDP_MODE_OFFLOAD)){
+            s->EnableOffload();
+        }
         return s;
     }
 
@@ -189,6 +295,9 @@ void UdpSocket::Close(){
         //关闭描述符 
         close(m_fd);
     }
+    m_sendBuffer.clear();
+    m_sendEntries.clear();
+    m_sendBlocked = false;
 
     m_fd = -1;
     m_state = SocketState::close;
@@ -198,52 +307,75 @@ void UdpSocket::Close(){
 
 void UdpSocket::Read(char* max_read_buffer, size_t max_read_size){
     SetLastAccessTime(time(NULL));
-	sockaddr_in sock;
-	socklen_t sock_size = sizeof(sock);
-    
-	int n = recvfrom(m_fd, max_read_buffer, max_read_size, 0, (sockaddr*)(&sock), &sock_size);
-
-    if (n == -1) {
-        if(errno != EAGAIN){
-			return;
+    //边缘触发模式下需要一直读到EAGAIN，但每轮不超过容器的公平预算，防止饿死其他连接
+    bool edgeTriggered = m_container->IsEdgeTriggered();
+    BudgetTracker budget(m_container);
+    while(true){
+        sockaddr_in sock;
+        socklen_t sock_size = sizeof(sock);
+        
+        int n = recvfrom(m_fd, max_read_buffer, max_read_size, 0, (sockaddr*)(&sock), &sock_size);
+        m_container->GetStats().m_udpRecvCalls.fetch_add(1, std::memory_order_relaxed);
+
+        if (n == -1) {
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                return;
+            }
+            LOG_ERROR("udp fd:%d socket:%p %s",m_fd, this, strerror(errno));
+            Close();
+            return;
         }
-		else{
-			LOG_ERROR("udp fd:%d socket:%p %s",m_fd, this, strerror(errno));
+        else if (n == 0) {
+            LOG_INFO("udp fd:%d socket:%p peer close %s:%u", m_fd, this, 
+                inet_ntoa(sock.sin_addr), ntohs(sock.sin_port));
             Close();
             return;
-		}
-    }
-	else if (n == 0) {
-        LOG_INFO("udp fd:%d socket:%p peer close %s:%u", m_fd, this, 
-			inet_ntoa(sock.sin_addr), ntohs(sock.sin_port));
-        Close();
-        return;
-    }
-	else{
-		m_input->append(max_read_buffer, n);
-		
-		int pn = 0;
+        }
+
+        m_container->GetStats().m_udpRecvCount.fetch_add(1, std::memory_order_relaxed);
+        //监听socket没有固定的对端，回复给数据报的来源
+        if(SocketState::listen == m_state){
+            m_peerAddr = sock;
+        }
+        m_input->append(max_read_buffer, n);
+        
+        int pn = 0;
         if(m_handler){
             pn = m_handler->HandlePacket(m_input->data(), m_input->size(), this);
         }
 
-		if(pn > 0){
-			m_input->erase(0,pn);
-			LOG_DEBUG("udp fd:%d socket:%p unpack size:%d", m_fd, this, pn);
-		}
-		else if(pn == 0){
-			LOG_DEBUG("udp fd:%d socket:%p unpack size:0", m_fd, this);
-		}
-		else{
-			//解包失败
-			LOG_ERROR("udp fd:%d socket:%p unpack failed",m_fd, this);
-			Close();
-		}
-		return;
-	}
+        if(pn > 0){
+            m_input->erase(0,pn);
+            LOG_DEBUG("udp fd:%d socket:%p unpack size:%d", m_fd, this, pn);
+        }
+        else if(pn == 0){
+            LOG_DEBUG("udp fd:%d socket:%p unpack size:0", m_fd, this);
+        }
+        else{
+            //解包失败
+            LOG_ERROR("udp fd:%d socket:%p unpack failed",m_fd, this);
+            Close();
+            return;
+        }
+
+        if(!edgeTriggered || m_state == SocketState::close){
+            return;
+        }
+        if(budget.Consume(n)){
+            m_container->AddPendingSocket(this, SOCKET_EVENT_READ);
+            return;
+        }
+    }
 }
 
 bool UdpSocket::SendPacket(const char* data, size_t size){
+    return SendPacketTo(data, size, m_peerAddr);
+}
+
+bool UdpSocket::SendPacketTo(const char* data, size_t size, const struct sockaddr_in& addr){
 	SetLastAccessTime(time(NULL));
 
     if(SocketState::listen != m_state && SocketState::connected != m_state){
@@ -254,7 +386,33 @@ bool UdpSocket::SendPacket(const char* data, size_t size){
 		return true;
 	}
 
-	int n = sendto(m_fd, data, size, 0, (struct sockaddr*)&m_peerAddr, sizeof(struct sockaddr));
+    if(m_batch){
+        if(m_sendEntries.size() >= UDP_SEND_QUEUE_MAX){
+            LOG_ERROR("udp fd:%d socket:%p send queue full, drop size:%zu", m_fd, this, size);
+            return false;
+        }
+        SendEntry entry;
+        entry.m_offset = m_sendBuffer.size();
+        entry.m_size = size;
+        entry.m_addr = addr;
+        m_sendBuffer.append(data, size);
+        m_sendEntries.push_back(entry);
+        if(m_sendBlocked){
+            return true;
+        }
+        //攒满一批直接发，否则等本轮事件循环末尾一起发；分段卸载时一个消息可以装下多个数据报
+        size_t batchCount = m_gso ? UDP_BATCH_SIZE * UDP_GSO_MAX_SEGMENTS : UDP_BATCH_SIZE;
+        if(m_sendEntries.size() >= batchCount){
+            FlushBatch();
+        }
+        else{
+            m_container->AddFlushSocket(this);
+        }
+        return true;
+    }
+
+	int n = sendto(m_fd, data, size, 0, (struct sockaddr*)&addr, sizeof(struct sockaddr));
+    m_container->GetStats().m_udpSendCalls.fetch_add(1, std::memory_order_relaxed);
     if (n == -1) {
         LOG_ERROR("udp fd:%d socket:%p send error:%s", m_fd, this, strerror(errno));
 		return false;
@@ -264,6 +422,247 @@ bool UdpSocket::SendPacket(const char* data, size_t size){
         return false;
     }
 	else{
+        m_container->GetStats().m_udpSendCount.fetch_add(1, std::memory_order_relaxed);
 		return true;
 	}
-}
\ No newline at end of file
+}
+
+void UdpSocket::SetMode(int mode){
+    //分段卸载建立在批量收发之上
+    bool batch = 0 != (mode & (UDP_MODE_BATCH | UDP_MODE_OFFLOAD));
+#ifdef __APPLE__
+    if(batch){
+        LOG_INFO("udp fd:%d socket:%p recvmmsg/sendmmsg not supported, batch mode disabled", m_fd, this);
+    }
+    m_batch = false;
+#else
+    m_batch = batch;
+#endif
+}
+
+void UdpSocket::EnableOffload(){
+#ifndef __APPLE__
+    if(!m_batch){
+        return;
+    }
+    //能读到UDP_SEGMENT说明内核支持，每次发送时再用控制消息指定段大小
+    int value = 0;
+    socklen_t len = sizeof(value);
+    m_gso = (0 == getsockopt(m_fd, SOL_UDP, UDP_SEGMENT, &value, &len));
+    if(!m_gso){
+        LOG_INFO("udp fd:%d socket:%p UDP_SEGMENT not supported %s", m_fd, this, strerror(errno));
+    }
+    value = 1;
+    m_gro = (0 == setsockopt(m_fd, SOL_UDP, UDP_GRO, &value, sizeof(value)));
+    if(!m_gro){
+        LOG_INFO("udp fd:%d socket:%p UDP_GRO not supported %s", m_fd, this, strerror(errno));
+    }
+    LOG_INFO("udp fd:%d socket:%p gso:%d gro:%d", m_fd, this, m_gso, m_gro);
+#endif
+}
+
+void UdpSocket::ReadBatch(){
+#ifndef __APPLE__
+    SetLastAccessTime(time(NULL));
+    if(nullptr == m_recvBatch){
+        m_recvBatch = new RecvBatch;
+    }
+    ContainerStats& stats = m_container->GetStats();
+    //边缘触发模式下需要一直读到EAGAIN，但每轮不超过容器的公平预算，防止饿死其他连接
+    bool edgeTriggered = m_container->IsEdgeTriggered();
+    BudgetTracker budget(m_container);
+    while(true){
+        for(int i = 0; i < UDP_BATCH_SIZE; ++i){
+            struct msghdr& hdr = m_recvBatch->m_msgs[i].msg_hdr;
+            hdr.msg_namelen = sizeof(struct sockaddr_in);
+            hdr.msg_control = m_gro ? m_recvBatch->m_control[i] : NULL;
+            hdr.msg_controllen = m_gro ? sizeof(m_recvBatch->m_control[i]) : 0;
+        }
+        int n = recvmmsg(m_fd, m_recvBatch->m_msgs, UDP_BATCH_SIZE, 0, NULL);
+        stats.m_udpRecvCalls.fetch_add(1, std::memory_order_relaxed);
+        if (n == -1) {
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                return;
+            }
+            LOG_ERROR("udp fd:%d socket:%p %s",m_fd, this, strerror(errno));
+            Close();
+            return;
+        }
+
+        size_t bytes = 0;
+        for(int i = 0; i < n; ++i){
+            struct msghdr& hdr = m_recvBatch->m_msgs[i].msg_hdr;
+            size_t size = m_recvBatch->m_msgs[i].msg_len;
+            bytes += size;
+            //GRO合并的大包带回段大小，没有说明是普通数据报
+            size_t segmentSize = size;
+            for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); m_gro && nullptr != cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)){
+                if(SOL_UDP == cmsg->cmsg_level && UDP_GRO == cmsg->cmsg_type){
+                    int gso = 0;
+                    memcpy(&gso, CMSG_DATA(cmsg), sizeof(gso));
+                    if(gso > 0){
+                        segmentSize = gso;
+                    }
+                }
+            }
+            //监听socket没有固定的对端，回复给数据报的来源
+            if(SocketState::listen == m_state){
+                m_peerAddr = m_recvBatch->m_addrs[i];
+            }
+            if(!DispatchDatagram(m_recvBatch->m_slab[i], size, segmentSize)){
+                return;
+            }
+        }
+
+        //没读满一批说明接收缓冲区已经读空
+        if(!edgeTriggered || n < UDP_BATCH_SIZE){
+            return;
+        }
+        if(budget.Consume(bytes, n)){
+            m_container->AddPendingSocket(this, SOCKET_EVENT_READ);
+            return;
+        }
+    }
+#endif
+}
+
+bool UdpSocket::DispatchDatagram(const char* data, size_t size, size_t segmentSize){
+    if(size < 1){
+        return true;
+    }
+    size_t count = (size + segmentSize - 1) / segmentSize;
+    m_container->GetStats().m_udpRecvCount.fetch_add(count, std::memory_order_relaxed);
+    if(nullptr == m_handler){
+        return true;
+    }
+    for(size_t offset = 0; offset < size; offset += segmentSize){
+        size_t len = size - offset < segmentSize ? size - offset : segmentSize;
+        int pn = m_handler->HandlePacket(data + offset, len, this);
+        if(m_state == SocketState::close){
+            return false;
+        }
+        if(pn < 0){
+            //解包失败
+            LOG_ERROR("udp fd:%d socket:%p unpack failed",m_fd, this);
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool UdpSocket::SendSegments(const char* data, size_t size, size_t segmentSize, const struct sockaddr_in& addr){
+    if(segmentSize < 1){
+        return false;
+    }
+    //按段排队，发送时相邻的同地址、同大小的段会被合成一个大包
+    for(size_t offset = 0; offset < size; offset += segmentSize){
+        size_t len = size - offset < segmentSize ? size - offset : segmentSize;
+        if(!SendPacketTo(data + offset, len, addr)){
+            return false;
+        }
+    }
+    return true;
+}
+
+void UdpSocket::FlushBatch(){
+#ifndef __APPLE__
+    if(m_sendEntries.empty()){
+        return;
+    }
+    ContainerStats& stats = m_container->GetStats();
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+    char control[UDP_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+    size_t entryCount[UDP_BATCH_SIZE];      //每个消息包含的数据报个数
+    size_t sent = 0;
+    while(sent < m_sendEntries.size()){
+        int count = 0;
+        size_t i = sent;
+        while(i < m_sendEntries.size() && count < UDP_BATCH_SIZE){
+            SendEntry& first = m_sendEntries[i];
+            //发往同一地址的连续数据报，除最后一个外大小都相同，可以合成一个大包
+            size_t j = i + 1;
+            size_t total = first.m_size;
+            while(m_gso && j < m_sendEntries.size() && j - i < UDP_GSO_MAX_SEGMENTS){
+                SendEntry& next = m_sendEntries[j];
+                if(m_sendEntries[j - 1].m_size != first.m_size || next.m_size > first.m_size
+                    || total + next.m_size > UDP_GSO_MAX_SIZE
+                    || next.m_addr.sin_addr.s_addr != first.m_addr.sin_addr.s_addr
+                    || next.m_addr.sin_port != first.m_addr.sin_port){
+                    break;
+                }
+                total += next.m_size;
+                ++j;
+            }
+            iovs[count].iov_base = &m_sendBuffer[first.m_offset];
+            iovs[count].iov_len = total;
+            memset(&msgs[count], 0, sizeof(msgs[count]));
+            msgs[count].msg_hdr.msg_name = &first.m_addr;
+            msgs[count].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[count].msg_hdr.msg_iov = &iovs[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+            if(j - i > 1){
+                msgs[count].msg_hdr.msg_control = control[count];
+                msgs[count].msg_hdr.msg_controllen = sizeof(control[count]);
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[count].msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segmentSize = (uint16_t)first.m_size;
+                memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+            }
+            entryCount[count] = j - i;
+            ++count;
+            i = j;
+        }
+        int n = sendmmsg(m_fd, msgs, count, 0);
+        stats.m_udpSendCalls.fetch_add(1, std::memory_order_relaxed);
+        if(n == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                //剩下的等可写时再发
+                if(!m_container->ModSocket(this, SOCKET_EVENT_READ|SOCKET_EVENT_WRITE|SOCKET_EVENT_ERROR)){
+                    LOG_ERROR("udp fd:%d socket:%p %s", m_fd, this, strerror(errno));
+                    Close();
+                    return;
+                }
+                m_sendBlocked = true;
+                break;
+            }
+            if(entryCount[0] > 1 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)){
+                //内核或者网卡不支持分段卸载，退回逐个发送
+                LOG_ERROR("udp fd:%d socket:%p UDP_SEGMENT rejected %s, fallback", m_fd, this, strerror(errno));
+                m_gso = false;
+                continue;
+            }
+            //只是这个数据报发不出去(例如目的地不可达)，丢掉它继续发后面的
+            LOG_ERROR("udp fd:%d socket:%p send error:%s", m_fd, this, strerror(errno));
+            sent += entryCount[0];
+            continue;
+        }
+        for(int k = 0; k < n; ++k){
+            sent += entryCount[k];
+            stats.m_udpSendCount.fetch_add(entryCount[k], std::memory_order_relaxed);
+        }
+    }
+
+    if(sent >= m_sendEntries.size()){
+        //保留容量，下一批不用重新分配
+        m_sendBuffer.clear();
+        m_sendEntries.clear();
+        return;
+    }
+    size_t offset = m_sendEntries[sent].m_offset;
+    m_sendBuffer.erase(0, offset);
+    m_sendEntries.erase(m_sendEntries.begin(), m_sendEntries.begin() + sent);
+    for(size_t i = 0; i < m_sendEntries.size(); ++i){
+        m_sendEntries[i].m_offset -= offset;
+    }
+#endif
+}
@@ -11,6 +11,9 @@
 #include <errno.h>
 #include <cstring>
 #include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <typeinfo>
 
 #include "socket_base.h"
 #include "blockbuffer.h"
@@ -18,13 +21,29 @@
 #include "../sys/util.h"
 
 namespace deps{
+/**
+ * 批量模式：接收时一次recvmmsg最多读UDP_BATCH_SIZE个数据报，逐个交给HandlePacket，
+ * 监听socket处理每个数据报前把来源地址设为GetPeerAddr()，直接SendPacket就是回复给来源；
+ * 发送的数据报先排队，在本轮事件循环末尾用sendmmsg一次发出。接收缓冲区需要UDP_BATCH_SIZE*MAX_READ_BUFF_SIZE内存。
+ */
+const int UDP_MODE_BATCH = 1;
+/**
+ * 分段卸载模式(包含批量模式)：发送时把发往同一地址、大小相同的连续数据报合成一个最大64K的大包，
+ * 用UDP_SEGMENT交给内核切分；接收时打开UDP_GRO，内核合并的大包在这里按段切开后逐个交给HandlePacket。
+ * 内核不支持(linux 4.18/5.0以下)或者拒绝时自动退回普通的批量收发。
+ */
+const int UDP_MODE_OFFLOAD = 2;
+
 class UdpSocket : public SocketBase{
 public:
-	static bool Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler);
-	static SocketBase* Connect(uint32_t ip, int port, SocketContainer *pContainer, PacketHandler* handler); 
+    //mode是UDP_MODE_*的组合
+	static bool Listen(int port, int backlog, SocketContainer *pContainer, PacketHandler* handler, int mode = 0);
+	static SocketBase* Connect(uint32_t ip, int port, SocketContainer *pContainer, PacketHandler* handler, int mode = 0); 
 
     UdpSocket(SocketContainer *pContainer, PacketHandler* handler);
     ~UdpSocket();
+    //优先从容器的回收池里取对象，池里没有时new
+    static UdpSocket* Create(SocketContainer *pContainer, PacketHandler* handler);
     UdpSocket()=delete;
     UdpSocket(const UdpSocket&)=delete;
     UdpSocket& operator=(const UdpSocket&)=delete;
@@ -33,14 +52,45 @@ public:
 	virtual void HandleWrite();
     virtual void HandleError();
     virtual void HandleTimeout();
+    virtual void HandleFlush();
 
     virtual bool SendPacket(const char* data, size_t size);
+    using SocketBase::SendPacket;
+    //发送到指定地址
+    bool SendPacketTo(const char* data, size_t size, const struct sockaddr_in& addr);
+    //把大块数据按segmentSize切成多个数据报发送，分段卸载模式下一次系统调用发出最多64K
+    bool SendSegments(const char* data, size_t size, size_t segmentSize, const struct sockaddr_in& addr);
     virtual void Close();
+    virtual bool Recycle();
 private:
+    //把除了容器、协议解析和缓冲区对象以外的成员恢复成初始值
+    void Reset();
     void Read(char* max_read_buffer, size_t max_read_size);
+    void ReadBatch();
+    void SetMode(int mode);
+    //打开UDP_SEGMENT/UDP_GRO，内核不支持时退回普通的批量收发
+    void EnableOffload();
+    //接收到的数据报交给协议解析，GRO合并的大包按段切开，返回false表示连接已经关闭
+    bool DispatchDatagram(const char* data, size_t size, size_t segmentSize);
+    //用sendmmsg发送排队的数据报，发送缓冲区满时等待可写事件
+    void FlushBatch();
 	void SetRecvBufferSize(uint32_t size);
 	void SetSendBufferSize(uint32_t size);
 private:
+    struct RecvBatch;
+    //排队等待发送的数据报，数据在m_sendBuffer里
+    struct SendEntry{
+        size_t m_offset;
+        size_t m_size;
+        struct sockaddr_in m_addr;
+    };
     BlockBuffer<def_block_alloc_4k, 1024>* m_input;              //接收缓冲区
+    bool m_batch;                                                //是否批量模式
+    bool m_gso;                                                  //发送是否使用UDP_SEGMENT
+    bool m_gro;                                                  //接收是否打开UDP_GRO
+    RecvBatch* m_recvBatch;                                      //批量接收的缓冲区，第一次读的时候分配
+    std::string m_sendBuffer;                                    //排队的数据报
+    std::vector<SendEntry> m_sendEntries;
+    bool m_sendBlocked;                                          //发送缓冲区满，等待可写事件
 };
 }
\ No newline at end of file